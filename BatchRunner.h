@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Compiler.h"
+#include "ThreadPool.h"
+#include "RunCache.h"
+#include "multi_tape_turing_machine.h"
+#include "Sequence.h"
+#include "exceptions.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <limits>
+
+enum class BatchStatus {
+    Accepted,
+    Halted,     // нет перехода из текущего состояния
+    StepLimit,  // исчерпан лимит шагов
+    Error
+};
+
+struct BatchResult {
+    BatchStatus status;
+    size_t steps;
+    Sequence<std::string> outputs;  // содержимое лент в окне вывода
+    std::string error;
+
+    BatchResult() : status(BatchStatus::Error), steps(0) {}
+
+    std::string StatusName() const {
+        switch (status) {
+        case BatchStatus::Accepted: return "accepted";
+        case BatchStatus::Halted: return "halted";
+        case BatchStatus::StepLimit: return "step-limit";
+        default: return "error";
+        }
+    }
+};
+
+struct BatchOptions {
+    size_t threads = 0;  // 0 - по числу ядер
+    size_t max_steps = 1000000;
+    ExecutionEngine engine = ExecutionEngine::Threaded;
+    // Окно вывода; если from > to, берётся вся материализованная область ленты
+    int64_t window_from = 0;
+    int64_t window_to = -1;
+    size_t chunk_size = 4;  // входов на одну задачу пула
+    RunCache* cache = nullptr;  // повторные входы берутся из кэша
+};
+
+// Пакетный прогон одной скомпилированной программы на множестве входов
+class BatchRunner {
+private:
+    std::unique_ptr<TuringMachine> prototype;
+    BatchOptions options;
+
+public:
+    BatchRunner(const Sequence<TuringMachineCompiler::ParsedTransition>& transitions,
+        int tapeCount,
+        const Sequence<std::string>& acceptStates,
+        const std::string& startState = "q0",
+        const BatchOptions& opts = BatchOptions(),
+        const Sequence<TuringMachineCompiler::ParsedMachine>& machines = Sequence<TuringMachineCompiler::ParsedMachine>())
+        : prototype(CreateTuringMachine(startState, static_cast<size_t>(tapeCount), ' ', opts.max_steps, opts.engine)),
+        options(opts) {
+        TuringMachineCompiler::AddMachines(*prototype, machines);
+        for (size_t i = 0; i < transitions.GetSize(); ++i) {
+            TuringMachineCompiler::AddToMachine(*prototype, transitions[i]);
+        }
+        for (size_t i = 0; i < acceptStates.GetSize(); ++i) {
+            prototype->SetAcceptState(acceptStates[i]);
+        }
+        // Компилируем один раз: копии машины разделяют скомпилированную программу
+        prototype->Finalize();
+    }
+
+    const BatchOptions& GetOptions() const {
+        return options;
+    }
+
+    Sequence<BatchResult> Run(const Sequence<Sequence<std::string>>& inputs) const {
+        Sequence<BatchResult> results(inputs.GetSize());
+        if (inputs.IsEmpty()) {
+            return results;
+        }
+
+        WorkStealingPool pool(options.threads);
+        Sequence<std::unique_ptr<TuringMachine>> machines(pool.GetThreadCount());
+        for (size_t i = 0; i < machines.GetSize(); ++i) {
+            machines[i] = prototype->Clone();
+        }
+
+        // Мелкие задачи: время прогона сильно различается, свободные потоки забирают чужие задачи
+        size_t chunk = std::max<size_t>(1, options.chunk_size);
+        for (size_t first = 0; first < inputs.GetSize(); first += chunk) {
+            size_t last = std::min(first + chunk, inputs.GetSize());
+            pool.Submit([this, &pool, &inputs, &results, &machines, first, last] {
+                TuringMachine& machine = *machines[static_cast<size_t>(pool.GetWorkerIndex())];
+                for (size_t i = first; i < last; ++i) {
+                    results[i] = RunOne(machine, inputs[i]);
+                }
+            });
+        }
+        pool.Wait();
+        return results;
+    }
+
+    Sequence<BatchResult> RunFile(const std::string& path) const {
+        return Run(LoadInputs(path, prototype->GetActiveTapeCount()));
+    }
+
+    // Одна строка файла - один набор входов, ленты разделены табуляцией
+    static Sequence<Sequence<std::string>> LoadInputs(const std::string& path, size_t tapeCount) {
+        std::ifstream in(path);
+        if (!in) {
+            throw InvalidArgumentException("Cannot open input file: " + path);
+        }
+
+        Sequence<Sequence<std::string>> inputs;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+
+            Sequence<std::string> tuple;
+            std::istringstream fields(line);
+            std::string field;
+            while (tuple.GetSize() < tapeCount && std::getline(fields, field, '\t')) {
+                tuple.Append(field);
+            }
+            while (tuple.GetSize() < tapeCount) {
+                tuple.Append("");
+            }
+            inputs.Append(tuple);
+        }
+        return inputs;
+    }
+
+private:
+    BatchResult RunOne(TuringMachine& machine, const Sequence<std::string>& input) const {
+        BatchResult result;
+        RunResult run;
+        try {
+            machine.Reset(input);
+            run = options.cache ? options.cache->Run(machine) : machine.Run(RunOptions());
+        }
+        catch (const std::exception& e) {
+            result.status = BatchStatus::Error;
+            result.error = e.what();
+            return result;
+        }
+
+        switch (run.status) {
+        case RunStatus::Accepted:
+            result.status = BatchStatus::Accepted;
+            break;
+        case RunStatus::Halted:
+            result.status = BatchStatus::Halted;
+            break;
+        case RunStatus::StepLimit:
+            result.status = BatchStatus::StepLimit;
+            break;
+        default:
+            result.status = BatchStatus::Error;
+            result.error = RunStatusName(run.status);
+            return result;
+        }
+
+        result.steps = run.steps;
+        for (size_t i = 0; i < machine.GetActiveTapeCount(); ++i) {
+            int64_t from = options.window_from;
+            int64_t to = options.window_to;
+            if (from > to) {
+                from = machine.GetTape(i)->GetMinIndex();
+                to = machine.GetTape(i)->GetMaxIndex();
+            }
+            result.outputs.Append(machine.GetTapeContent(i, from, to));
+        }
+        return result;
+    }
+};
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "Sequence.h"
-#include <unordered_map>  
+#include "TapeInput.h"
+#include <vector>
 #include <set>
 #include <string>
 #include <memory>
@@ -11,136 +12,1253 @@
 #include <optional>
 #include <sstream>
 #include <array>
-#include <limits> 
-#include <algorithm> 
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// Способ хранения ячеек ленты
+enum class TapeStorage {
+    Paged,     // страницы ячеек: любая ячейка за O(1)
+    RunLength  // отрезки одинаковых ячеек: длинный однородный участок занимает O(1) памяти
+};
 
 template <typename T>
 class BidirectionalLazyTape {
 private:
-    // Структура для хранения ячейки 
-    struct Cell {
-        T value; // Значение в ячейке
-        bool is_modified;  // Флаг, была ли ячейка изменена пользователем
+    // Лента хранится страницами по PAGE_SIZE ячеек, страницы растут от нуля в обе стороны.
+    // Страница заполняется входом и пустыми символами при выделении; флаги отмечают
+    // материализованные (прочитанные или записанные) и изменённые ячейки.
+    // Каталог двухуровневый: блоки по BLOCK_PAGES указателей на страницы.
+    // Копия ленты разделяет с оригиналом каталог, блоки и страницы; при первой записи с любой
+    // стороны копируются верхний уровень каталога, блок и страница ячейки
+    static constexpr int PAGE_BITS = 8;
+    static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+    static constexpr int WORD_COUNT = PAGE_SIZE / 64;
+    static constexpr int BLOCK_BITS = 6;
+    static constexpr int BLOCK_PAGES = 1 << BLOCK_BITS;
+
+    struct Page {
+        std::array<T, PAGE_SIZE> values;
+        std::array<uint64_t, WORD_COUNT> materialized;
+        std::array<uint64_t, WORD_COUNT> modified;
+
+        Page() {}  // ячейки заполняет SeekPage, обнулять их заранее незачем
+    };
+
+    using Block = std::array<std::shared_ptr<Page>, BLOCK_PAGES>;  // nullptr - страница ещё не нужна
+
+    // Отрезок одинаковых ячеек для хранения RunLength. Все ячейки отрезков материализованы,
+    // ячейки между отрезками содержат символ входа или пустой символ
+    struct Run {
+        int64_t length;
+        T value;
+        bool modified;
+    };
+
+    using RunMap = std::map<int64_t, Run>;  // индекс первой ячейки -> отрезок
 
-        Cell() : value(T()), is_modified(false) {}
-        Cell(const T& val, bool modified = false) : value(val), is_modified(modified) {}
+    struct Directory {
+        int64_t first = 0;  // номер блока blocks[0]
+        std::vector<std::shared_ptr<Block>> blocks;  // nullptr - в блоке нет страниц
+        // Поколение: растёт, когда каталог разделяет новая копия ленты. Копия может
+        // делаться из константной ленты в нескольких потоках, поэтому счётчик атомарный
+        std::atomic<uint64_t> generation{ 0 };
+
+        Directory() = default;
+        Directory(const Directory& other) : first(other.first), blocks(other.blocks) {}
     };
 
-   // Хэш-таблица для хранения ячеек
-    mutable std::unordered_map<int, Cell> cells;
+    mutable std::shared_ptr<Directory> directory;  // nullptr - ни одной страницы
+    // Не nullptr - лента хранится отрезками, страниц нет. Копии разделяют отрезки до записи
+    mutable std::shared_ptr<RunMap> runs;
+    // Палец: отрезок последнего обращения, головка обычно остаётся в нём или уходит в соседний
+    mutable typename RunMap::iterator finger;
+    mutable bool finger_valid = false;
+    // Курсор: последняя страница, к которой обращалась головка. Соседние ячейки
+    // читаются и пишутся без поиска страницы. Курсор ставится только на страницу, которая
+    // принадлежит одной этой ленте. Копирование исходную ленту не трогает, а сдвигает
+    // поколение каталога: писать через курсор можно, пока поколение то же, что при установке
+    mutable Page* cursor = nullptr;
+    mutable int64_t cursor_base = 0;  // индекс первой ячейки страницы курсора
+    // Предыдущая страница курсора: головка, качающаяся на границе страниц, не ищет их заново
+    mutable Page* previous = nullptr;
+    mutable int64_t previous_base = 0;
+    mutable uint64_t cursor_generation = 0;  // поколение каталога для обоих курсоров
+    // Статистика ведётся при каждой отметке ячейки; материализация необратима до очистки,
+    // поэтому границы только расширяются. Счётчик и границы - по ячейкам страниц или отрезков,
+    // ячейки входа без них добавляются при выдаче
+    mutable size_t materialized_count = 0;
+    mutable int64_t min_index = 0;
+    mutable int64_t max_index = 0;
+    size_t modified_count = 0;
     T blank_symbol; // символ пустой ячейки
-    std::string initial_input; // входная строка
+    std::shared_ptr<TapeInput> initial_input; // вход, общий для копий
+    const char* input_data = nullptr; // байты входа (копия initial_input->Data())
+    // Известная ленте часть входа. Потоковый вход дочитывается, когда обращение уходит правее:
+    // новые ячейки сразу входят в статистику и хэш. Страницы и отрезки лежат только
+    // в известной части (или вход уже закончился)
+    mutable size_t input_length = 0;
+    mutable bool input_complete = true; // вход известен целиком
+    // Ячейки входа материализованы от инициализации до очистки, но в страницах или отрезках
+    // хранятся только тронутые: остальные читаются из входа
+    bool input_materialized = false;
+    mutable size_t input_stored = 0; // ячейки входа среди materialized_count
+    bool hashing = false; // поддерживать ли хэш содержимого
+    mutable uint64_t content_hash = 0; // сумма хэшей непустых ячеек
 
-public:
-    BidirectionalLazyTape(T blank = T())
-        : blank_symbol(blank) {
+    static int64_t PageOf(int64_t index) {
+        return index >= 0 ? index >> PAGE_BITS : ~((~index) >> PAGE_BITS);
     }
 
-    T Get(int index) const {
-        // Ищем ячейку в хэш-таблице
-        auto it = cells.find(index);
+    static int64_t BlockOf(int64_t page_no) {
+        return page_no >= 0 ? page_no >> BLOCK_BITS : ~((~page_no) >> BLOCK_BITS);
+    }
 
-        if (it != cells.end()) {
-            return it->second.value;
+    // Обойти выделенные страницы по возрастанию: f(индекс первой ячейки, страница)
+    template <typename F>
+    void ForEachPage(F&& f) const {
+        if (!directory) {
+            return;
+        }
+        for (size_t k = 0; k < directory->blocks.size(); ++k) {
+            if (!directory->blocks[k]) continue;
+            int64_t block_page = (directory->first + static_cast<int64_t>(k)) * BLOCK_PAGES;
+            for (int j = 0; j < BLOCK_PAGES; ++j) {
+                if ((*directory->blocks[k])[j]) {
+                    f((block_page + j) * PAGE_SIZE, *(*directory->blocks[k])[j]);
+                }
+            }
         }
+    }
 
-        // Ленивая материализация: создаём ячейку при первом обращении
-        T value;
-        if (index >= 0 && index < static_cast<int>(initial_input.length())) {
-            value = initial_input[index];
+    static bool Test(const std::array<uint64_t, WORD_COUNT>& flags, int offset) {
+        return (flags[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    size_t InputLength() const {
+        return input_length;
+    }
+
+    void SetInput(std::shared_ptr<TapeInput> input) {
+        initial_input = std::move(input);
+        input_data = initial_input ? initial_input->Data() : nullptr;
+        input_length = 0;
+        input_complete = true;
+        if (initial_input) {
+            input_length = initial_input->Require(0, input_complete);
+        }
+    }
+
+    // Тот же вход и его известная часть, что у other
+    void ShareInput(const BidirectionalLazyTape& other) {
+        initial_input = other.initial_input;
+        input_data = other.input_data;
+        input_length = other.input_length;
+        input_complete = other.input_complete;
+    }
+
+    // Дочитать вход до ячейки end (не включая) или до его конца
+    void ExtendInput(int64_t end) const {
+        if (input_complete || end <= static_cast<int64_t>(input_length)) {
+            return;
+        }
+        size_t known = input_length;
+        input_length = initial_input->Require(static_cast<size_t>(end), input_complete);
+        if (hashing) {
+            content_hash += InitialHash(static_cast<int64_t>(known), static_cast<int64_t>(input_length));
+        }
+    }
+
+    T InitialValue(int64_t index) const {
+        if (static_cast<uint64_t>(index) < input_length) {
+            return input_data[index];
+        }
+        if (!input_complete && index >= 0) {
+            ExtendInput(index + 1);
+            if (static_cast<uint64_t>(index) < input_length) {
+                return input_data[index];
+            }
+        }
+        return blank_symbol;
+    }
+
+    // Сколько ячеек [from, to) лежит во входе
+    int64_t InputOverlap(int64_t from, int64_t to) const {
+        return std::max<int64_t>(0, std::min<int64_t>(to, static_cast<int64_t>(input_length)) - std::max<int64_t>(from, 0));
+    }
+
+    // Материализованные ячейки входа, которых нет в страницах или отрезках
+    size_t ImplicitCount() const {
+        return input_materialized ? input_length - input_stored : 0;
+    }
+
+    // Вклад ячейки в хэш содержимого; пустые ячейки не учитываются
+    uint64_t CellHash(int64_t index, T value) const {
+        if (value == blank_symbol) return 0;
+        uint64_t x = (static_cast<uint64_t>(index) << 8) ^
+            static_cast<unsigned char>(value);
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    void RecomputeContentHash() {
+        content_hash = 0;
+        if (runs) {
+            for (const auto& entry : *runs) {
+                content_hash += RangeHash(entry.first, entry.first + entry.second.length, entry.second.value);
+            }
+        }
+        // Ячейки входа вне страниц и отрезков
+        if (runs) {
+            int64_t covered = 0;
+            for (const auto& entry : *runs) {
+                content_hash += InitialHash(covered, entry.first);
+                covered = std::max(covered, entry.first + entry.second.length);
+            }
+            content_hash += InitialHash(covered, static_cast<int64_t>(input_length));
+            return;
+        }
+        ForEachPage([this](int64_t base, const Page& page) {
+            for (int offset = 0; offset < PAGE_SIZE; ++offset) {
+                content_hash += CellHash(base + offset, page.values[offset]);
+            }
+        });
+        for (int64_t base = 0; base < static_cast<int64_t>(input_length); base += PAGE_SIZE) {
+            if (!FindPage(base)) {
+                content_hash += InitialHash(base, base + PAGE_SIZE);
+            }
+        }
+    }
+
+    // Сумма хэшей ячеек [from, to) с одним значением
+    uint64_t RangeHash(int64_t from, int64_t to, T value) const {
+        uint64_t sum = 0;
+        if (value != blank_symbol) {
+            for (int64_t i = from; i < to; ++i) {
+                sum += CellHash(i, value);
+            }
+        }
+        return sum;
+    }
+
+    // Сумма хэшей начальных значений ячеек [from, to)
+    uint64_t InitialHash(int64_t from, int64_t to) const {
+        uint64_t sum = 0;
+        int64_t first = std::max<int64_t>(from, 0);
+        int64_t last = std::min<int64_t>(to, static_cast<int64_t>(InputLength()));
+        for (int64_t i = first; i < last; ++i) {
+            sum += CellHash(i, input_data[i]);
+        }
+        return sum;
+    }
+
+    const Page* FindPage(int64_t index) const {
+        if (!directory) {
+            return nullptr;
+        }
+        int64_t page_no = PageOf(index);
+        int64_t block_no = BlockOf(page_no);
+        int64_t slot = block_no - directory->first;
+        if (slot < 0 || slot >= static_cast<int64_t>(directory->blocks.size()) || !directory->blocks[slot]) {
+            return nullptr;
+        }
+        return (*directory->blocks[slot])[page_no - block_no * BLOCK_PAGES].get();
+    }
+
+    void ResetCursors() const {
+        cursor = nullptr;
+        previous = nullptr;
+    }
+
+    // Можно ли писать через курсоры: с их установки каталог никто не разделял
+    bool CursorCurrent() const {
+        return directory->generation.load(std::memory_order_relaxed) == cursor_generation;
+    }
+
+    // Единственный ли владелец. Забор acquire упорядочивает запись после последних чтений
+    // прежних владельцев, которые отпустили объект (сам use_count() этого не даёт)
+    template <typename Shared>
+    static bool Exclusive(const std::shared_ptr<Shared>& shared) {
+        if (shared.use_count() != 1) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    // Освободить страницы или отрезки. Собственные каталог и блоки остаются для следующего
+    // заполнения, чтобы повторные короткие прогоны не выделяли их заново.
+    // Страница выделяется только под материализуемую ячейку, поэтому все страницы
+    // лежат между min_index и max_index
+    void DropCells() {
+        ResetCursors();
+        if (runs) {
+            if (!Exclusive(runs)) {
+                runs = std::make_shared<RunMap>();
+            }
+            else {
+                runs->clear();
+            }
+            finger_valid = false;
+            return;
+        }
+        if (!directory || !Exclusive(directory)) {
+            directory.reset();
+            return;
+        }
+        if (materialized_count == 0) {
+            return;
+        }
+        // Обходятся только блоки каталога: между далёкими ячейками страниц может не быть
+        int64_t first_page = PageOf(min_index);
+        int64_t last_page = PageOf(max_index);
+        int64_t first_slot = std::max<int64_t>(BlockOf(first_page) - directory->first, 0);
+        int64_t last_slot = std::min<int64_t>(BlockOf(last_page) - directory->first,
+            static_cast<int64_t>(directory->blocks.size()) - 1);
+        for (int64_t slot = first_slot; slot <= last_slot; ++slot) {
+            std::shared_ptr<Block>& block = directory->blocks[slot];
+            if (!block) {
+                continue;
+            }
+            if (!Exclusive(block)) {
+                block.reset();
+                continue;
+            }
+            int64_t block_page = (directory->first + slot) * BLOCK_PAGES;
+            int64_t from = std::max<int64_t>(first_page - block_page, 0);
+            int64_t to = std::min<int64_t>(last_page - block_page, BLOCK_PAGES - 1);
+            for (int64_t j = from; j <= to; ++j) {
+                if ((*block)[j]) {
+                    (*block)[j].reset();
+                }
+            }
+        }
+    }
+
+    // Каталог, принадлежащий только этой ленте
+    Directory& MutableDirectory() const {
+        if (!directory) {
+            directory = std::make_shared<Directory>();
+        }
+        else if (!Exclusive(directory)) {
+            // Курсоры остались на страницах прежнего каталога
+            ResetCursors();
+            directory = std::make_shared<Directory>(*directory);
+        }
+        return *directory;
+    }
+
+    // Страница ячейки index (с выделением или копированием общих блока и страницы)
+    // становится страницей курсора
+    void SeekPage(int64_t index) const {
+        if (cursor && !CursorCurrent()) {
+            ResetCursors();
+        }
+        if (SwapCursor(index)) {
+            return;
+        }
+        int64_t page_no = PageOf(index);
+        int64_t block_no = BlockOf(page_no);
+        Directory& dir = MutableDirectory();
+        if (dir.blocks.empty()) {
+            dir.first = block_no;
+        }
+        if (block_no < dir.first) {
+            // Расширяем с запасом, чтобы движение влево не сдвигало каталог на каждом блоке
+            int64_t grow = std::max(dir.first - block_no, static_cast<int64_t>(dir.blocks.size()));
+            dir.blocks.insert(dir.blocks.begin(), static_cast<size_t>(grow), nullptr);
+            dir.first -= grow;
+        }
+        size_t slot = static_cast<size_t>(block_no - dir.first);
+        if (slot >= dir.blocks.size()) {
+            dir.blocks.resize(std::max(slot + 1, 2 * dir.blocks.size()));
+        }
+
+        std::shared_ptr<Block>& block = dir.blocks[slot];
+        if (!block) {
+            block = std::make_shared<Block>();
+        }
+        else if (!Exclusive(block)) {
+            block = std::make_shared<Block>(*block);
+        }
+        std::shared_ptr<Page>& page = (*block)[page_no - block_no * BLOCK_PAGES];
+        if (!page) {
+            ExtendInput((page_no + 1) * PAGE_SIZE);
+            page = std::make_shared<Page>();
+            page->materialized.fill(0);
+            page->modified.fill(0);
+            // Ячейки входа копируются одним куском, остальные пустые
+            int64_t base = page_no * PAGE_SIZE;
+            int64_t from = std::max<int64_t>(base, 0);
+            int64_t to = std::min<int64_t>(base + PAGE_SIZE, static_cast<int64_t>(InputLength()));
+            T* values = page->values.data();
+            if (from < to) {
+                std::fill(values, values + (from - base), blank_symbol);
+                std::copy(input_data + from, input_data + to, values + (from - base));
+                std::fill(values + (to - base), values + PAGE_SIZE, blank_symbol);
+            }
+            else {
+                std::fill(values, values + PAGE_SIZE, blank_symbol);
+            }
+        }
+        else if (!Exclusive(page)) {
+            page = std::make_shared<Page>(*page);
+        }
+        previous = cursor;
+        previous_base = cursor_base;
+        cursor = page.get();
+        cursor_base = page_no * PAGE_SIZE;
+        cursor_generation = dir.generation.load(std::memory_order_relaxed);
+    }
+
+    // Перейти на предыдущую страницу курсора, если ячейка на ней
+    bool SwapCursor(int64_t index) const {
+        if (!previous || static_cast<uint64_t>(index) - static_cast<uint64_t>(previous_base) >= static_cast<uint64_t>(PAGE_SIZE)) {
+            return false;
+        }
+        std::swap(cursor, previous);
+        std::swap(cursor_base, previous_base);
+        return true;
+    }
+
+    // Смещение ячейки в странице курсора; курсор переходит на страницу ячейки
+    int Locate(int64_t index) const {
+        uint64_t offset = static_cast<uint64_t>(index) - static_cast<uint64_t>(cursor_base);
+        if (!cursor || offset >= static_cast<uint64_t>(PAGE_SIZE) || !CursorCurrent()) {
+            SeekPage(index);
+            offset = static_cast<uint64_t>(index) - static_cast<uint64_t>(cursor_base);
+        }
+        return static_cast<int>(offset);
+    }
+
+    // Учесть новую материализованную ячейку
+    void CountMaterialized(int64_t index) const {
+        if (static_cast<uint64_t>(index) < input_length) {
+            input_stored++;
+        }
+        if (materialized_count++ == 0) {
+            min_index = max_index = index;
         }
         else {
-            value = blank_symbol;
+            min_index = std::min(min_index, index);
+            max_index = std::max(max_index, index);
         }
+    }
 
-        // Сохраняем в хэш-таблицу с пометкой "не модифицирована"
-        cells[index] = Cell(value, false);
-        return value;
+    // Отметить ячейку страницы курсора материализованной
+    void Materialize(int offset) const {
+        uint64_t& word = cursor->materialized[offset >> 6];
+        uint64_t bit = uint64_t(1) << (offset & 63);
+        if (word & bit) {
+            return;
+        }
+        word |= bit;
+        CountMaterialized(cursor_base + offset);
     }
 
-    void Set(int index, T value) {
-        auto it = cells.find(index);
+    void MarkModified(int offset) {
+        uint64_t& word = cursor->modified[offset >> 6];
+        uint64_t bit = uint64_t(1) << (offset & 63);
+        if (!(word & bit)) {
+            word |= bit;
+            modified_count++;
+        }
+    }
+
+    void ResetStatistics() {
+        materialized_count = 0;
+        modified_count = 0;
+        min_index = max_index = 0;
+        input_materialized = false;
+        input_stored = 0;
+    }
 
-        if (it != cells.end()) {
-            it->second.value = value;
-            it->second.is_modified = true;
+    void Write(int offset, int64_t index, T value) {
+        if (hashing) {
+            content_hash += CellHash(index, value) - CellHash(index, cursor->values[offset]);
+        }
+        cursor->values[offset] = value;
+        Materialize(offset);
+        MarkModified(offset);
+    }
+
+    T PeekSlow(int64_t index) const {
+        if (runs) {
+            auto it = FindRun(index);
+            return it != runs->end() ? it->second.value : InitialValue(index);
+        }
+        if (cursor && CursorCurrent() && SwapCursor(index)) {
+            return cursor->values[index - cursor_base];
+        }
+        if (!directory) {
+            return InitialValue(index);
+        }
+        int64_t page_no = PageOf(index);
+        int64_t block_no = BlockOf(page_no);
+        int64_t slot = block_no - directory->first;
+        if (slot < 0 || slot >= static_cast<int64_t>(directory->blocks.size()) || !directory->blocks[slot]) {
+            return InitialValue(index);
+        }
+        const std::shared_ptr<Block>& block = directory->blocks[slot];
+        const std::shared_ptr<Page>& page = (*block)[page_no - block_no * BLOCK_PAGES];
+        if (!page) {
+            return InitialValue(index);
+        }
+        int64_t base = page_no * PAGE_SIZE;
+        // Общую страницу читаем мимо курсора: запись через курсор изменила бы копии.
+        // Поколение берём до проверки владения: копия, сделанная после неё, его сдвинет.
+        // Чтение двигает курсор, поэтому одну ленту читают из одного потока, другим - копии
+        uint64_t generation = directory->generation.load(std::memory_order_relaxed);
+        if (Exclusive(directory) && Exclusive(block) && Exclusive(page)) {
+            if (!cursor || !CursorCurrent()) {
+                previous = nullptr;
+            }
+            else {
+                previous = cursor;
+                previous_base = cursor_base;
+            }
+            cursor = page.get();
+            cursor_base = base;
+            cursor_generation = generation;
+        }
+        return page->values[index - base];
+    }
+
+    // Отрезки, принадлежащие только этой ленте
+    RunMap& MutableRuns() const {
+        if (!Exclusive(runs)) {
+            runs = std::make_shared<RunMap>(*runs);
+            finger_valid = false;
+        }
+        return *runs;
+    }
+
+    static bool Contains(typename RunMap::const_iterator it, int64_t index) {
+        return it->first <= index && index < it->first + it->second.length;
+    }
+
+    // Первый отрезок, начинающийся правее index. Рядом с пальцем ищется без обхода дерева
+    typename RunMap::iterator UpperRun(int64_t index) const {
+        RunMap& map = *runs;
+        if (finger_valid) {
+            if (index >= finger->first) {
+                auto next = std::next(finger);
+                if (next == map.end() || index < next->first) {
+                    return next;
+                }
+                auto after = std::next(next);
+                if (after == map.end() || index < after->first) {
+                    return after;
+                }
+            }
+            else if (finger == map.begin() || std::prev(finger)->first <= index) {
+                return finger;
+            }
+        }
+        return map.upper_bound(index);
+    }
+
+    // Отрезок с ячейкой index или runs->end()
+    typename RunMap::iterator FindRun(int64_t index) const {
+        RunMap& map = *runs;
+        if (finger_valid && Contains(finger, index)) {
+            return finger;
+        }
+        auto it = UpperRun(index);
+        if (it == map.begin()) {
+            return map.end();
+        }
+        --it;
+        if (!Contains(it, index)) {
+            return map.end();
+        }
+        finger = it;
+        finger_valid = true;
+        return it;
+    }
+
+    // Материализовать ячейку промежутка: значение и флаг модификации не меняются
+    void MaterializeGap(int64_t index, T value) const {
+        ExtendInput(index + 1);
+        RunMap& map = MutableRuns();
+        finger = MergeRun(map, map.emplace_hint(UpperRun(index), index, Run{ 1, value, false }));
+        finger_valid = true;
+        CountMaterialized(index);
+    }
+
+    // Перенести начало отрезка на at
+    static typename RunMap::iterator Rekey(RunMap& map, typename RunMap::iterator it, int64_t at) {
+        auto hint = std::next(it);
+        auto node = map.extract(it);
+        node.key() = at;
+        return map.insert(hint, std::move(node));
+    }
+
+    // Запись одной ячейки на краю отрезка за O(1): ячейка переходит к примыкающему соседу
+    // с тем же значением и флагом. false - нужен общий случай
+    bool AssignCell(int64_t index, T value, bool modified) {
+        RunMap& map = *runs;
+        auto up = UpperRun(index);
+        auto run = map.end();  // отрезок с ячейкой
+        auto left = map.end();  // примыкающий слева сосед
+        auto right = map.end();  // примыкающий справа сосед
+        if (up != map.begin()) {
+            auto prev = std::prev(up);
+            if (Contains(prev, index)) {
+                run = prev;
+            }
+            else if (prev->first + prev->second.length == index) {
+                left = prev;
+            }
+        }
+        if (run != map.end()) {
+            if (run->second.value == value && run->second.modified == modified) {
+                finger = run;
+                finger_valid = true;
+                return true;
+            }
+            if (index == run->first && run != map.begin()) {
+                auto prev = std::prev(run);
+                if (prev->first + prev->second.length == index) {
+                    left = prev;
+                }
+            }
+        }
+        if (up != map.end() && up->first == index + 1 &&
+            (run == map.end() || index == run->first + run->second.length - 1)) {
+            right = up;
+        }
+        auto matches = [&](typename RunMap::iterator it) {
+            return it != map.end() && it->second.value == value && it->second.modified == modified;
+        };
+        bool to_left = matches(left);
+        if (!to_left && !matches(right)) {
+            return false;
+        }
+
+        T old = run != map.end() ? run->second.value : InitialValue(index);
+        if (hashing) {
+            content_hash += CellHash(index, value) - CellHash(index, old);
+        }
+        if (run != map.end()) {
+            if (run->second.modified) {
+                modified_count--;
+            }
+            if (run->second.length == 1) {
+                map.erase(run);
+            }
+            else if (to_left) {
+                run->second.length--;
+                Rekey(map, run, index + 1);
+            }
+            else {
+                run->second.length--;
+            }
+        }
+        else {
+            CountMaterialized(index);
+        }
+        if (modified) {
+            modified_count++;
+        }
+
+        if (to_left) {
+            left->second.length++;
+            finger = MergeRun(map, left);
         }
         else {
-            // Создаём новую ячейку с пометкой "модифицирована"
-            cells[index] = Cell(value, true);
+            right->second.length++;
+            finger = MergeRun(map, Rekey(map, right, index));
         }
+        finger_valid = true;
+        return true;
     }
 
-    void Initialize(const std::string& input) {
-        cells.clear(); 
-        initial_input = input;
+    // Разрезать отрезок, внутри которого начинается ячейка at
+    static void SplitRun(RunMap& map, int64_t at) {
+        auto it = map.upper_bound(at);
+        if (it == map.begin()) {
+            return;
+        }
+        --it;
+        int64_t end = it->first + it->second.length;
+        if (it->first == at || end <= at) {
+            return;
+        }
+        Run right{ end - at, it->second.value, it->second.modified };
+        it->second.length = at - it->first;
+        map.emplace_hint(std::next(it), at, right);
+    }
 
-        for (size_t i = 0; i < input.length(); ++i) {
-            cells[static_cast<int>(i)] = Cell(input[i], false);
+    // Склеить отрезок с соседями, если они примыкают и совпадают
+    static typename RunMap::iterator MergeRun(RunMap& map, typename RunMap::iterator it) {
+        if (it != map.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second.length == it->first &&
+                prev->second.value == it->second.value && prev->second.modified == it->second.modified) {
+                prev->second.length += it->second.length;
+                map.erase(it);
+                it = prev;
+            }
+        }
+        auto next = std::next(it);
+        if (next != map.end() && it->first + it->second.length == next->first &&
+            next->second.value == it->second.value && next->second.modified == it->second.modified) {
+            it->second.length += next->second.length;
+            map.erase(next);
         }
+        return it;
     }
 
-    size_t GetMaterializedCount() const {
-        return cells.size();
+    // Записать value в ячейки [from, to) с флагом модификации modified; ячейки материализуются
+    void AssignRun(int64_t from, int64_t to, T value, bool modified) {
+        ExtendInput(to);
+        RunMap& map = MutableRuns();
+        if (to == from + 1 && AssignCell(from, value, modified)) {
+            return;
+        }
+        auto it = FindRun(from);
+        if (it != map.end() && it->second.value == value && it->second.modified == modified &&
+            to <= it->first + it->second.length) {
+            return;
+        }
+
+        SplitRun(map, from);
+        SplitRun(map, to);
+        int64_t covered = from;  // ячейки [from, covered) уже учтены
+        it = map.lower_bound(from);
+        while (it != map.end() && it->first < to) {
+            const Run& old = it->second;
+            if (hashing) {
+                content_hash -= InitialHash(covered, it->first) + RangeHash(it->first, it->first + old.length, old.value);
+            }
+            materialized_count -= static_cast<size_t>(old.length);
+            input_stored -= static_cast<size_t>(InputOverlap(it->first, it->first + old.length));
+            if (old.modified) {
+                modified_count -= static_cast<size_t>(old.length);
+            }
+            covered = it->first + old.length;
+            it = map.erase(it);
+        }
+        if (hashing) {
+            content_hash += RangeHash(from, to, value) - InitialHash(covered, to);
+        }
+
+        size_t length = static_cast<size_t>(to - from);
+        if (materialized_count == 0) {
+            min_index = from;
+            max_index = to - 1;
+        }
+        else {
+            min_index = std::min(min_index, from);
+            max_index = std::max(max_index, to - 1);
+        }
+        materialized_count += length;
+        input_stored += static_cast<size_t>(InputOverlap(from, to));
+        if (modified) {
+            modified_count += length;
+        }
+        finger = MergeRun(map, map.emplace_hint(it, from, Run{ to - from, value, modified }));
+        finger_valid = true;
     }
 
-    // получить количество модифицированных ячеек
-    size_t GetModifiedCount() const {
+    // Сколько ячеек промежутка между отрезками, начиная с p в направлении direction,
+    // имеют то же начальное значение, что и p
+    int64_t GapExtent(int64_t p, int direction) const {
+        const int64_t length = static_cast<int64_t>(InputLength());
+        auto next = runs->upper_bound(p);
+        if (direction > 0) {
+            int64_t bound = next == runs->end() ? std::numeric_limits<int64_t>::max() / 4 : next->first;
+            if (p < 0) {
+                bound = std::min<int64_t>(bound, 0);
+            }
+            else if (p < length) {
+                int64_t end = std::min(bound, length);
+                int64_t e = p + 1;
+                while (e < end && input_data[e] == input_data[p]) ++e;
+                bound = e;
+            }
+            return bound - p;
+        }
+        int64_t bound = std::numeric_limits<int64_t>::min() / 4;  // ближайшая ячейка за промежутком
+        if (next != runs->begin()) {
+            auto prev = std::prev(next);
+            bound = prev->first + prev->second.length - 1;
+        }
+        if (p >= length) {
+            bound = std::max(bound, length - 1);
+        }
+        else if (p >= 0) {
+            int64_t end = std::max<int64_t>(bound, -1);
+            int64_t e = p - 1;
+            while (e > end && input_data[e] == input_data[p]) --e;
+            bound = e;
+        }
+        return p - bound;
+    }
+
+    // Пробег по отрезкам: однородный участок переписывается целиком
+    size_t SweepRuns(int64_t& position, int direction, const uint8_t* matches, const char* rewrite, size_t max_count) {
+        size_t count = 0;
+        while (count < max_count) {
+            int64_t p = position;
+            T symbol;
+            int64_t available;
+            auto it = FindRun(p);
+            if (it != runs->end()) {
+                symbol = it->second.value;
+                available = direction > 0 ? it->first + it->second.length - p : p - it->first + 1;
+            }
+            else {
+                symbol = InitialValue(position);
+                available = GapExtent(p, direction);
+            }
+            if (!matches[static_cast<unsigned char>(symbol)]) {
+                return count;
+            }
+            // Головка остаётся в пределах int64_t
+            uint64_t room = direction > 0
+                ? static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) - static_cast<uint64_t>(p)
+                : static_cast<uint64_t>(p) - static_cast<uint64_t>(std::numeric_limits<int64_t>::min());
+            int64_t n = static_cast<int64_t>(std::min({ static_cast<uint64_t>(available), room,
+                static_cast<uint64_t>(max_count - count) }));
+            if (n <= 0) {
+                return count;
+            }
+            if (direction > 0) {
+                AssignRun(p, p + n, rewrite[static_cast<unsigned char>(symbol)], true);
+            }
+            else {
+                AssignRun(p - n + 1, p + 1, rewrite[static_cast<unsigned char>(symbol)], true);
+            }
+            position = p + direction * n;
+            count += static_cast<size_t>(n);
+        }
+        return count;
+    }
+
+    // Материализовать ячейки [first, first + text.size()) пустой ленты отрезками
+    void FillRuns(int64_t first, const std::string& text, bool modified) {
+        RunMap& map = MutableRuns();
+        for (size_t i = 0; i < text.size();) {
+            size_t j = i + 1;
+            while (j < text.size() && text[j] == text[i]) ++j;
+            map.emplace_hint(map.end(), first + static_cast<int64_t>(i),
+                Run{ static_cast<int64_t>(j - i), static_cast<T>(text[i]), modified });
+            i = j;
+        }
+        if (!text.empty()) {
+            materialized_count = text.size();
+            modified_count = modified ? text.size() : 0;
+            min_index = first;
+            max_index = first + static_cast<int64_t>(text.size()) - 1;
+            input_stored = static_cast<size_t>(InputOverlap(first, first + static_cast<int64_t>(text.size())));
+        }
+    }
+
+    // Обойти ячейки страниц или отрезков по возрастанию: f(индекс, значение, изменена ли).
+    // Материализованные ячейки входа вне них не обходятся
+    template <typename F>
+    void ForEachCell(F&& f) const {
+        if (runs) {
+            for (const auto& entry : *runs) {
+                for (int64_t i = entry.first; i < entry.first + entry.second.length; ++i) {
+                    f(i, entry.second.value, entry.second.modified);
+                }
+            }
+            return;
+        }
+        ForEachPage([&f](int64_t base, const Page& page) {
+            for (int offset = 0; offset < PAGE_SIZE; ++offset) {
+                if (Test(page.materialized, offset)) {
+                    f(base + offset, page.values[offset], Test(page.modified, offset));
+                }
+            }
+        });
+    }
+
+    void CopyFrom(const BidirectionalLazyTape& other) {
+        // Страницы становятся общими: новое поколение запрещает оригиналу писать через курсор.
+        // Сам оригинал не меняется, копировать его можно из нескольких потоков
+        directory = other.directory;
+        if (directory) {
+            directory->generation.fetch_add(1, std::memory_order_relaxed);
+        }
+        runs = other.runs;
+        finger_valid = false;
+        ResetCursors();
+        materialized_count = other.materialized_count;
+        min_index = other.min_index;
+        max_index = other.max_index;
+        modified_count = other.modified_count;
+        blank_symbol = other.blank_symbol;
+        ShareInput(other);
+        input_materialized = other.input_materialized;
+        input_stored = other.input_stored;
+        hashing = other.hashing;
+        content_hash = other.content_hash;
+    }
+
+    void MoveFrom(BidirectionalLazyTape& other) {
+        directory = std::move(other.directory);
+        runs = std::move(other.runs);
+        finger = other.finger;
+        finger_valid = other.finger_valid;
+        cursor = other.cursor;
+        cursor_base = other.cursor_base;
+        previous = other.previous;
+        previous_base = other.previous_base;
+        cursor_generation = other.cursor_generation;
+        materialized_count = other.materialized_count;
+        min_index = other.min_index;
+        max_index = other.max_index;
+        modified_count = other.modified_count;
+        blank_symbol = other.blank_symbol;
+        ShareInput(other);
+        input_materialized = other.input_materialized;
+        input_stored = other.input_stored;
+        hashing = other.hashing;
+        content_hash = other.content_hash;
+        other.directory.reset();
+        other.SetInput(nullptr);
+        other.finger_valid = false;
+        other.ResetCursors();
+        other.ResetStatistics();
+    }
+
+public:
+    BidirectionalLazyTape(T blank = T(), TapeStorage storage = TapeStorage::Paged)
+        : blank_symbol(blank) {
+        if (storage == TapeStorage::RunLength) {
+            runs = std::make_shared<RunMap>();
+        }
+    }
+
+    // Копирование за O(1): страницы общие до первой записи
+    BidirectionalLazyTape(const BidirectionalLazyTape& other) {
+        CopyFrom(other);
+    }
+
+    BidirectionalLazyTape(BidirectionalLazyTape&& other) noexcept {
+        MoveFrom(other);
+    }
+
+    BidirectionalLazyTape& operator=(const BidirectionalLazyTape& other) {
+        if (this != &other) {
+            CopyFrom(other);
+        }
+        return *this;
+    }
+
+    BidirectionalLazyTape& operator=(BidirectionalLazyTape&& other) noexcept {
+        if (this != &other) {
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    TapeStorage GetStorage() const {
+        return runs ? TapeStorage::RunLength : TapeStorage::Paged;
+    }
+
+    // Сменить способ хранения; содержимое, флаги ячеек и статистика сохраняются
+    void SetStorage(TapeStorage storage) {
+        if (storage == GetStorage()) {
+            return;
+        }
+        BidirectionalLazyTape converted(blank_symbol, storage);
+        converted.ShareInput(*this);
+        ForEachCell([&converted](int64_t index, T value, bool modified) {
+            converted.Restore(index, value, modified);
+        });
+        converted.input_materialized = input_materialized;
+        converted.hashing = hashing;
+        // Страницы могли дочитать потоковый вход дальше
+        converted.content_hash = content_hash +
+            converted.InitialHash(static_cast<int64_t>(input_length), static_cast<int64_t>(converted.input_length));
+        *this = std::move(converted);
+    }
+
+    T Get(int64_t index) const {
+        if (runs) {
+            auto it = FindRun(index);
+            if (it != runs->end()) {
+                return it->second.value;
+            }
+            T value = InitialValue(index);
+            // Ячейка входа уже материализована, отрезок под неё не нужен
+            if (!input_materialized || static_cast<uint64_t>(index) >= input_length) {
+                MaterializeGap(index, value);
+            }
+            return value;
+        }
+        int offset = Locate(index);
+        // Ленивая материализация: ячейка отмечается при первом обращении
+        Materialize(offset);
+        return cursor->values[offset];
+    }
+
+    // Чтение без материализации: ячейка не создаётся, лента не растёт.
+    // Непрочитанная ячейка содержит символ входа или пустой символ
+    T Peek(int64_t index) const {
+        uint64_t offset = static_cast<uint64_t>(index) - static_cast<uint64_t>(cursor_base);
+        if (cursor && offset < static_cast<uint64_t>(PAGE_SIZE)) {
+            return cursor->values[offset];
+        }
+        return PeekSlow(index);
+    }
+
+    void Set(int64_t index, T value) {
+        // У ленты из отрезков курсора нет, её проверка не стоит на быстром пути
+        uint64_t offset = static_cast<uint64_t>(index) - static_cast<uint64_t>(cursor_base);
+        if (!cursor || offset >= static_cast<uint64_t>(PAGE_SIZE) || !CursorCurrent()) {
+            if (runs) {
+                AssignRun(index, index + 1, value, true);
+                return;
+            }
+            SeekPage(index);
+            offset = static_cast<uint64_t>(index) - static_cast<uint64_t>(cursor_base);
+        }
+        Write(static_cast<int>(offset), index, value);
+    }
+
+    // Включить инкрементальный хэш содержимого (для поиска зацикливания)
+    void EnableContentHash(bool enabled) {
+        hashing = enabled;
+        if (hashing) {
+            RecomputeContentHash();
+        }
+    }
+
+    uint64_t GetContentHash() const {
+        return content_hash;
+    }
+
+    bool IsModified(int64_t index) const {
+        if (runs) {
+            auto it = FindRun(index);
+            return it != runs->end() && it->second.modified;
+        }
+        const Page* page = FindPage(index);
+        return page && Test(page->modified, static_cast<int>(index - PageOf(index) * PAGE_SIZE));
+    }
+
+    // Вернуть ячейке прежние значение и флаг модификации (откат шага)
+    void Restore(int64_t index, T value, bool modified) {
+        if (runs) {
+            AssignRun(index, index + 1, value, modified);
+            return;
+        }
+        int offset = Locate(index);
+        Write(offset, index, value);
+        if (!modified) {
+            cursor->modified[offset >> 6] &= ~(uint64_t(1) << (offset & 63));
+            modified_count--;
+        }
+    }
+
+    // Пробег головы: пока символ под головой входит в matches, он заменяется по таблице rewrite,
+    // а голова сдвигается на direction. Возвращает число пройденных ячеек (не больше max_count)
+    size_t Sweep(int64_t& position, int direction, const uint8_t* matches, const char* rewrite, size_t max_count) {
+        if (runs && (direction == 1 || direction == -1)) {
+            return SweepRuns(position, direction, matches, rewrite, max_count);
+        }
         size_t count = 0;
-        for (const auto& pair : cells) {
-            if (pair.second.is_modified) {
+        if (runs) {
+            // Шаг больше одной ячейки: пройденные ячейки не образуют отрезка, пишем по одной
+            for (; count < max_count; ++count, position += direction) {
+                T symbol = Peek(position);
+                if (!matches[static_cast<unsigned char>(symbol)]) {
+                    break;
+                }
+                AssignRun(position, position + 1, rewrite[static_cast<unsigned char>(symbol)], true);
+            }
+            return count;
+        }
+        while (count < max_count) {
+            // Первая несовпавшая ячейка только читается, страница под неё не выделяется
+            if (!matches[static_cast<unsigned char>(Peek(position))]) {
+                return count;
+            }
+            // Проход внутри одной страницы без поиска ячеек
+            int offset = Locate(position);
+            T* values = cursor->values.data();
+            while (count < max_count && offset >= 0 && offset < PAGE_SIZE) {
+                unsigned char symbol = static_cast<unsigned char>(values[offset]);
+                if (!matches[symbol]) {
+                    return count;
+                }
+                if (hashing) {
+                    content_hash += CellHash(position, rewrite[symbol]) - CellHash(position, values[offset]);
+                }
+                values[offset] = rewrite[symbol];
+                Materialize(offset);
+                MarkModified(offset);
+                position += direction;
+                offset += direction;
                 ++count;
             }
         }
         return count;
     }
 
-    std::string GetContent(int from, int to) const {
+    void Initialize(const std::string& input) {
+        StringTapeInput* owned = dynamic_cast<StringTapeInput*>(initial_input.get());
+        if (input.empty()) {
+            Initialize(std::shared_ptr<TapeInput>());
+        }
+        else if (owned && Exclusive(initial_input)) {
+            // Повторные прогоны переписывают строку на месте
+            owned->Assign(input);
+            Initialize(std::move(initial_input));
+        }
+        else {
+            Initialize(TapeInput::FromString(input));
+        }
+    }
+
+    // Вход без копирования: ячейки материализованы сразу, но читаются из input,
+    // пока в них не запишут. Потоковый вход дочитывается по мере обращений правее известной части
+    void Initialize(std::shared_ptr<TapeInput> input) {
+        DropCells();
+        ResetStatistics();
+        SetInput(std::move(input));
+        input_materialized = true;
+        if (hashing) {
+            RecomputeContentHash();
+        }
+    }
+
+    // Вход из файла, отображённого в память только для чтения
+    void InitializeFromFile(const std::string& path) {
+        Initialize(TapeInput::FromFile(path));
+    }
+
+    // Вход из чужой памяти; она должна пережить ленту и её копии
+    void InitializeFromView(std::string_view view) {
+        Initialize(TapeInput::FromView(view));
+    }
+
+    // Вход из дескриптора (канал, stdin), читаемый в фоне; машина работает, не дожидаясь его конца
+    void InitializeFromStream(int fd) {
+        Initialize(TapeInput::FromStream(fd));
+    }
+
+    size_t GetMaterializedCount() const {
+        return materialized_count + ImplicitCount();
+    }
+
+    // Известен ли вход целиком. Пока потоковый вход не дочитан, GetContent и GetImage
+    // показывают только прочитанную часть, а дальше - пустые ячейки
+    bool IsInputComplete() const {
+        return input_complete;
+    }
+
+    // получить количество модифицированных ячеек
+    size_t GetModifiedCount() const {
+        return modified_count;
+    }
+
+    std::string GetContent(int64_t from, int64_t to) const {
         std::string result;
-        for (int i = from; i <= to; ++i) {
-            result += Get(i);
+        if (from > to) {
+            return result;
+        }
+        result.reserve(static_cast<size_t>(static_cast<uint64_t>(to) - static_cast<uint64_t>(from) + 1));
+        for (int64_t i = from; i <= to; ++i) {
+            result += Peek(i);
+            if (i == std::numeric_limits<int64_t>::max()) break;
         }
         return result;
     }
 
-    int GetMinIndex() const {
-        if (cells.empty()) return 0;
+    // Содержимое от первой до последней известной ячейки (материализованной или из входа)
+    // без материализации; first - индекс первого символа
+    std::string GetImage(int64_t& first) const {
+        first = InputLength() == 0 ? std::numeric_limits<int64_t>::max() : 0;
+        int64_t last = InputLength() == 0 ? std::numeric_limits<int64_t>::min() : static_cast<int64_t>(InputLength()) - 1;
+        if (materialized_count > 0) {
+            first = std::min(first, min_index);
+            last = std::max(last, max_index);
+        }
+        std::string result;
+        if (first > last) {
+            first = 0;
+            return result;
+        }
+        result.reserve(static_cast<size_t>(last - first) + 1);
+        for (int64_t i = first; i <= last; ++i) {
+            result += Peek(i);
+        }
+        return result;
+    }
 
-        int min_index = std::numeric_limits<int>::max();
-        for (const auto& pair : cells) {
-            if (pair.first < min_index) {
-                min_index = pair.first;
+    // Заменить содержимое образом из GetImage; ячейки образа считаются изменёнными
+    void LoadImage(int64_t first, const std::string& image) {
+        DropCells();
+        ResetStatistics();
+        SetInput(nullptr);
+        bool was_hashing = hashing;
+        hashing = false;
+        if (runs) {
+            FillRuns(first, image, true);
+        }
+        else {
+            for (size_t i = 0; i < image.size(); ++i) {
+                Set(first + static_cast<int64_t>(i), image[i]);
             }
         }
-        return min_index;
+        hashing = was_hashing;
+        if (hashing) {
+            RecomputeContentHash();
+        }
     }
 
-    int GetMaxIndex() const {
-        if (cells.empty()) return 0;
+    int64_t GetMinIndex() const {
+        if (input_materialized && input_length > 0) {
+            return materialized_count > 0 ? std::min<int64_t>(min_index, 0) : 0;
+        }
+        return min_index;
+    }
 
-        int max_index = std::numeric_limits<int>::min();
-        for (const auto& pair : cells) {
-            if (pair.first > max_index) {
-                max_index = pair.first;
-            }
+    int64_t GetMaxIndex() const {
+        if (input_materialized && input_length > 0) {
+            int64_t last = static_cast<int64_t>(input_length) - 1;
+            return materialized_count > 0 ? std::max(max_index, last) : last;
         }
         return max_index;
     }
 
     void ClearMaterialized() {
-        cells.clear();
+        DropCells();
+        ResetStatistics();
+        if (hashing) {
+            RecomputeContentHash();
+        }
     }
 
     // получить все индексы в отсортированном порядке
-    Sequence<int> GetSortedIndices() const {
-        Sequence<int> indices;
-
-        for (const auto& pair : cells) {
-            indices.Append(pair.first);  
+    Sequence<int64_t> GetSortedIndices() const {
+        Sequence<int64_t> indices;
+        // Ячейки входа вне страниц и отрезков вставляются между хранимыми
+        int64_t next_input = 0;
+        int64_t input_end = input_materialized ? static_cast<int64_t>(input_length) : 0;
+        ForEachCell([&](int64_t index, T, bool) {
+            for (; next_input < input_end && next_input < index; ++next_input) {
+                indices.Append(next_input);
+            }
+            if (next_input == index) {
+                ++next_input;
+            }
+            indices.Append(index);
+        });
+        for (; next_input < input_end; ++next_input) {
+            indices.Append(next_input);
         }
-
-        int* data = indices.GetData();
-        std::sort(data, data + indices.GetSize());
         return indices;
     }
 };
@@ -4,65 +4,268 @@
 #include <map>
 #include <regex>
 #include <fstream>
+#include <vector>
 #include "multi_tape_turing_machine.h"
 #include "Sequence.h"
+#include "SymbolClass.h"
 
 class TuringMachineCompiler {
 public:
+    // Переход из текста. Для класса символов readSymbols хранит первый символ класса,
+    // сам класс - в readClasses; copyFrom[i] >= 0 - запись символа с ленты copyFrom[i].
+    // Непустой callMachine - вызов машины из блока machine с возвратом в toState
     struct ParsedTransition {
         std::string fromState;
         std::string toState;
-        std::array<char, 3> readSymbols;
-        std::array<char, 3> writeSymbols;
-        std::array<int, 3> moves;
+        std::array<char, TuringMachine::MAX_TAPES> readSymbols;
+        std::array<char, TuringMachine::MAX_TAPES> writeSymbols;
+        std::array<int, TuringMachine::MAX_TAPES> moves;
+        std::array<SymbolClass, TuringMachine::MAX_TAPES> readClasses;
+        std::array<int, TuringMachine::MAX_TAPES> copyFrom;
+        std::string callMachine;
 
         ParsedTransition() : readSymbols{}, writeSymbols{}, moves{} {
             readSymbols.fill(' ');
             writeSymbols.fill(' ');
             moves.fill(0);
+            readClasses.fill(SymbolClass::Single(' '));
+            copyFrom.fill(-1);
+        }
+
+        bool IsCall() const {
+            return !callMachine.empty();
+        }
+
+        // Есть класс из нескольких символов или копирование
+        bool IsPattern() const {
+            for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
+                if (!readClasses[i].IsSingle() || copyFrom[i] >= 0) return true;
+            }
+            return false;
+        }
+
+        TuringMachine::PatternTransition ToPattern() const {
+            TuringMachine::PatternTransition t;
+            t.state_from = fromState;
+            t.state_to = toState;
+            t.read_classes = readClasses;
+            t.write_symbols = writeSymbols;
+            t.copy_from = copyFrom;
+            t.moves = moves;
+            return t;
         }
     };
 
+    // Машина из блока "machine имя начальное -> допускающие ... end"
+    struct ParsedMachine {
+        std::string name;
+        std::string startState;
+        Sequence<std::string> acceptStates;
+        Sequence<ParsedTransition> transitions;
+    };
+
+    // Добавить разобранный переход в машину обычным переходом или переходом с классами
+    static void AddToMachine(TuringMachine& machine, const ParsedTransition& t) {
+        if (t.IsCall()) {
+            machine.AddCall(t.fromState, t.callMachine, t.toState);
+        }
+        else if (t.IsPattern()) {
+            machine.AddTransition(t.ToPattern());
+        }
+        else {
+            machine.AddTransition(t.fromState, t.readSymbols, t.toState, t.writeSymbols, t.moves);
+        }
+    }
+
+    // Создать машины из блоков и подключить их к machine как вложенные. Каждая машина
+    // создаётся один раз и разделяется всеми, кто её вызывает; блок видит блоки выше себя
+    static void AddMachines(TuringMachine& machine, const Sequence<ParsedMachine>& machines) {
+        std::vector<std::pair<std::string, std::shared_ptr<TuringMachine>>> created;
+        for (size_t i = 0; i < machines.GetSize(); ++i) {
+            const ParsedMachine& parsed = machines[i];
+            std::shared_ptr<TuringMachine> sub = CreateTuringMachine(parsed.startState, machine.GetActiveTapeCount(),
+                machine.GetBlankSymbol(), machine.GetMaxSteps(), machine.GetExecutionEngine());
+            for (const auto& previous : created) {
+                sub->AddSubMachine(previous.first, previous.second);
+            }
+            for (size_t k = 0; k < parsed.transitions.GetSize(); ++k) {
+                AddToMachine(*sub, parsed.transitions[k]);
+            }
+            for (size_t k = 0; k < parsed.acceptStates.GetSize(); ++k) {
+                sub->SetAcceptState(parsed.acceptStates[k]);
+            }
+            created.emplace_back(parsed.name, sub);
+        }
+        for (const auto& entry : created) {
+            machine.AddSubMachine(entry.first, entry.second);
+        }
+    }
+
+    // Переходы основной программы; блоки machine отбрасываются
     static Sequence<ParsedTransition> Compile(const std::string& code, int tapeCount, std::string& error) {
+        Sequence<ParsedMachine> machines;
+        return Compile(code, tapeCount, error, machines);
+    }
+
+    // Переходы основной программы и машины из блоков machine ... end.
+    // Вызвать можно только машину, описанную выше, поэтому рекурсия невозможна
+    static Sequence<ParsedTransition> Compile(const std::string& code, int tapeCount, std::string& error,
+        Sequence<ParsedMachine>& machines) {
         Sequence<ParsedTransition> transitions;
         error.clear();
+        machines.Clear();
 
         std::istringstream iss(code);
         std::string line;
         int lineNum = 0;
 
-        std::regex transRegex(R"((\w+)\s*,\s*([\w\s\+])\s*,\s*([\w\s\+])\s*,\s*([\w\s\+])\s*->\s*(\w+)\s*,\s*([\w\s\+])\s*,\s*([\w\s\+])\s*,\s*([\w\s\+])\s*,\s*([RLS])\s*,\s*([RLS])\s*,\s*([RLS]))");
+        // Число лент в строке определяется по числу столбцов; сначала пробуем самые длинные формы,
+        // чтобы короткое выражение не совпало с частью длинной строки
+        static const std::vector<std::regex> transRegexes = BuildRegexes();
+        static const std::regex machineRegex(R"(^\s*machine\s+(\w+)\s+(\w+)\s*->\s*(\w+(?:\s*,\s*\w+)*)\s*$)");
+        static const std::regex endRegex(R"(^\s*end\s*$)");
+        static const std::regex callRegex(R"(^\s*(\w+)\s+call\s+(\w+)\s*->\s*(\w+)\s*$)");
+
+        ParsedMachine block;
+        int blockLine = 0;  // строка заголовка открытого блока, 0 - блока нет
 
         while (std::getline(iss, line)) {
             lineNum++;
 
             if (line.empty() || line[0] == '#') continue;
 
+            Sequence<ParsedTransition>& target = blockLine ? block.transitions : transitions;
             std::smatch match;
-            if (!std::regex_search(line, match, transRegex)) {
+            if (std::regex_match(line, match, machineRegex)) {
+                std::string lineError = blockLine ? "Nested machine definition"
+                    : HasMachine(machines, match[1].str()) ? "Machine " + match[1].str() + " is already defined" : "";
+                if (!lineError.empty()) {
+                    error += "Line " + std::to_string(lineNum) + ": " + lineError + "\n";
+                    continue;
+                }
+                block = ParsedMachine();
+                block.name = match[1].str();
+                block.startState = match[2].str();
+                std::string accept = match[3].str();
+                std::smatch state;
+                static const std::regex stateRegex(R"(\w+)");
+                for (auto it = accept.cbegin(); std::regex_search(it, accept.cend(), state, stateRegex); it = state.suffix().first) {
+                    block.acceptStates.Append(state.str());
+                }
+                blockLine = lineNum;
+                continue;
+            }
+            if (std::regex_match(line, endRegex)) {
+                if (!blockLine) {
+                    error += "Line " + std::to_string(lineNum) + ": 'end' without machine\n";
+                    continue;
+                }
+                machines.Append(block);
+                blockLine = 0;
+                continue;
+            }
+            if (std::regex_match(line, match, callRegex)) {
+                if (!HasMachine(machines, match[2].str())) {
+                    error += "Line " + std::to_string(lineNum) + ": Unknown machine " + match[2].str() + "\n";
+                    continue;
+                }
+                ParsedTransition call;
+                call.fromState = match[1].str();
+                call.callMachine = match[2].str();
+                call.toState = match[3].str();
+                target.Append(call);
+                continue;
+            }
+
+            size_t columns = TuringMachine::MAX_TAPES;
+            while (columns > 0 && !std::regex_search(line, match, transRegexes[columns - 1])) {
+                columns--;
+            }
+            if (columns == 0) {
                 error += "Line " + std::to_string(lineNum) + ": Invalid format\n";
                 continue;
             }
 
             ParsedTransition trans;
+            std::string lineError;
             trans.fromState = match[1].str();
-            trans.toState = match[5].str();
-
-            trans.readSymbols[0] = (match[2].str() == " ") ? ' ' : match[2].str()[0];
-            trans.readSymbols[1] = (match[3].str() == " ") ? ' ' : match[3].str()[0];
-            trans.readSymbols[2] = (match[4].str() == " ") ? ' ' : match[4].str()[0];
+            trans.toState = match[columns + 2].str();
 
-            trans.writeSymbols[0] = (match[6].str() == " ") ? ' ' : match[6].str()[0];
-            trans.writeSymbols[1] = (match[7].str() == " ") ? ' ' : match[7].str()[0];
-            trans.writeSymbols[2] = (match[8].str() == " ") ? ' ' : match[8].str()[0];
+            for (size_t i = 0; i < columns; ++i) {
+                std::string read = match[2 + i].str();
+                std::string write = match[columns + 3 + i].str();
+                std::string move = match[2 * columns + 3 + i].str();
 
-            trans.moves[0] = (match[9].str() == "R") ? 1 : (match[9].str() == "L") ? -1 : 0;
-            trans.moves[1] = (match[10].str() == "R") ? 1 : (match[10].str() == "L") ? -1 : 0;
-            trans.moves[2] = (match[11].str() == "R") ? 1 : (match[11].str() == "L") ? -1 : 0;
+                try {
+                    trans.readClasses[i] = SymbolClass::Parse(read);
+                }
+                catch (const InvalidArgumentException& e) {
+                    lineError = e.what();
+                }
+                trans.readSymbols[i] = read.size() == 1 ? read[0] : FirstSymbol(trans.readClasses[i]);
+                if (write[0] == '=') {
+                    // "=" - символ своей ленты, "=k" - символ ленты k
+                    int source = write.size() == 1 ? static_cast<int>(i) : write[1] - '1';
+                    trans.copyFrom[i] = source;
+                    trans.writeSymbols[i] = ' ';
+                }
+                else {
+                    trans.writeSymbols[i] = write[0];
+                }
+                trans.moves[i] = (move == "R") ? 1 : (move == "L") ? -1 : 0;
+            }
 
-            transitions.Append(trans);
+            for (size_t i = 0; i < columns; ++i) {
+                if (trans.copyFrom[i] >= static_cast<int>(columns)) {
+                    lineError = "Tape " + std::to_string(trans.copyFrom[i] + 1) + " is not in the transition";
+                }
+            }
+            if (!lineError.empty()) {
+                error += "Line " + std::to_string(lineNum) + ": " + lineError + "\n";
+                continue;
+            }
+            target.Append(trans);
         }
 
+        if (blockLine) {
+            error += "Line " + std::to_string(blockLine) + ": Machine " + block.name + " is not closed with 'end'\n";
+        }
         return transitions;
     }
+
+private:
+    static bool HasMachine(const Sequence<ParsedMachine>& machines, const std::string& name) {
+        for (size_t i = 0; i < machines.GetSize(); ++i) {
+            if (machines[i].name == name) return true;
+        }
+        return false;
+    }
+
+    static char FirstSymbol(const SymbolClass& symbols) {
+        for (unsigned c = 0; c < 256; ++c) {
+            if (symbols.GetSymbols().test(c)) return static_cast<char>(c);
+        }
+        return ' ';
+    }
+
+    // from, r1..rN -> to, w1..wN, m1..mN
+    // from call имя -> to (вызов машины из блока machine имя начальное -> допускающие ... end)
+    // Чтение: символ, [a-z0-9] (перечисление и диапазоны), * (любой), !x (любой, кроме x).
+    // Запись: символ, = (прочитанный на этой ленте), =k (прочитанный на ленте k)
+    static std::vector<std::regex> BuildRegexes() {
+        const std::string read = R"(\s*,\s*(\[[^\],]+\]|\*|![\w\s\+]|[\w\s\+]))";
+        const std::string write = R"(\s*,\s*(=[1-8]?|[\w\s\+]))";
+        const std::string move = R"(\s*,\s*([RLS]))";
+
+        std::vector<std::regex> regexes;
+        for (size_t columns = 1; columns <= TuringMachine::MAX_TAPES; ++columns) {
+            std::string pattern = R"((\w+))";
+            for (size_t i = 0; i < columns; ++i) pattern += read;
+            pattern += R"(\s*->\s*(\w+))";
+            for (size_t i = 0; i < columns; ++i) pattern += write;
+            for (size_t i = 0; i < columns; ++i) pattern += move;
+            regexes.emplace_back(pattern);
+        }
+        return regexes;
+    }
 };
\ No newline at end of file
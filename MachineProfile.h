@@ -0,0 +1,177 @@
+#pragma once
+
+#include "Sequence.h"
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+
+// Результат профилирования машины: частоты переходов, шаги по состояниям, размах головок
+struct MachineProfile {
+    struct TransitionHits {
+        std::string from;
+        std::string read;   // символы по лентам
+        std::string to;
+        std::string write;
+        std::string moves;  // L, S, R по лентам
+        uint64_t hits;
+    };
+
+    struct StateSteps {
+        std::string state;
+        uint64_t steps;
+    };
+
+    struct TapeExcursion {
+        size_t tape;
+        int64_t min_head;
+        int64_t max_head;
+
+        // Наибольшее удаление головки от начала ленты
+        int64_t MaxExcursion() const {
+            return std::max(max_head, -min_head);
+        }
+    };
+
+    uint64_t total_steps = 0;
+    Sequence<TransitionHits> transitions;
+    Sequence<StateSteps> states;
+    Sequence<TapeExcursion> tapes;
+
+    std::string ToJson() const {
+        std::stringstream ss;
+        ss << "{\"total_steps\":" << total_steps << ",\"transitions\":[";
+        for (size_t i = 0; i < transitions.GetSize(); ++i) {
+            const TransitionHits& t = transitions[i];
+            ss << (i ? "," : "") << "{\"from\":" << JsonString(t.from)
+                << ",\"read\":" << JsonString(t.read)
+                << ",\"to\":" << JsonString(t.to)
+                << ",\"write\":" << JsonString(t.write)
+                << ",\"moves\":" << JsonString(t.moves)
+                << ",\"hits\":" << t.hits << "}";
+        }
+        ss << "],\"states\":[";
+        for (size_t i = 0; i < states.GetSize(); ++i) {
+            ss << (i ? "," : "") << "{\"state\":" << JsonString(states[i].state)
+                << ",\"steps\":" << states[i].steps << "}";
+        }
+        ss << "],\"tapes\":[";
+        for (size_t i = 0; i < tapes.GetSize(); ++i) {
+            ss << (i ? "," : "") << "{\"tape\":" << tapes[i].tape
+                << ",\"min_head\":" << tapes[i].min_head
+                << ",\"max_head\":" << tapes[i].max_head
+                << ",\"max_excursion\":" << tapes[i].MaxExcursion() << "}";
+        }
+        ss << "]}";
+        return ss.str();
+    }
+
+    // Одна строка на переход
+    std::string ToCsv() const {
+        std::stringstream ss;
+        ss << "from,read,to,write,moves,hits\n";
+        for (size_t i = 0; i < transitions.GetSize(); ++i) {
+            const TransitionHits& t = transitions[i];
+            ss << CsvField(t.from) << "," << CsvField(t.read) << "," << CsvField(t.to) << ","
+                << CsvField(t.write) << "," << CsvField(t.moves) << "," << t.hits << "\n";
+        }
+        return ss.str();
+    }
+
+    // Одна строка на состояние
+    std::string ToStateCsv() const {
+        std::stringstream ss;
+        ss << "state,steps\n";
+        for (size_t i = 0; i < states.GetSize(); ++i) {
+            ss << CsvField(states[i].state) << "," << states[i].steps << "\n";
+        }
+        return ss.str();
+    }
+
+    // Текстовый отчёт: состояния и переходы по убыванию числа шагов, top - сколько строк показывать
+    std::string ToText(size_t top = 20) const {
+        std::vector<size_t> state_order = SortedOrder(states, [](const StateSteps& s) { return s.steps; });
+        std::vector<size_t> transition_order = SortedOrder(transitions, [](const TransitionHits& t) { return t.hits; });
+
+        std::stringstream ss;
+        ss << "Total steps: " << total_steps << "\n\nStates:\n";
+        for (size_t k = 0; k < state_order.size() && k < top; ++k) {
+            const StateSteps& s = states[state_order[k]];
+            ss << "  " << std::left << std::setw(16) << s.state << std::right << std::setw(14) << s.steps
+                << "  " << Percent(s.steps) << "\n";
+        }
+
+        ss << "\nTransitions:\n";
+        for (size_t k = 0; k < transition_order.size() && k < top; ++k) {
+            const TransitionHits& t = transitions[transition_order[k]];
+            std::string rule = t.from + ", '" + t.read + "' -> " + t.to + ", '" + t.write + "', " + t.moves;
+            ss << "  " << std::left << std::setw(40) << rule << std::right << std::setw(14) << t.hits
+                << "  " << Percent(t.hits) << "\n";
+        }
+
+        ss << "\nHead excursion:\n";
+        for (size_t i = 0; i < tapes.GetSize(); ++i) {
+            ss << "  Tape " << (tapes[i].tape + 1) << ": [" << tapes[i].min_head << ", "
+                << tapes[i].max_head << "], max " << tapes[i].MaxExcursion() << "\n";
+        }
+        return ss.str();
+    }
+
+    // Строка в кавычках с экранированием для JSON; байты вне ASCII записываются как \u00XX
+    static std::string JsonString(const std::string& value) {
+        std::string result = "\"";
+        for (unsigned char c : value) {
+            switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (c < 0x20 || c >= 0x80) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    result += buffer;
+                }
+                else {
+                    result += static_cast<char>(c);
+                }
+            }
+        }
+        return result + "\"";
+    }
+
+private:
+    template <typename T, typename Key>
+    static std::vector<size_t> SortedOrder(const Sequence<T>& items, Key key) {
+        std::vector<size_t> order(items.GetSize());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return key(items[a]) > key(items[b]);
+        });
+        return order;
+    }
+
+    std::string Percent(uint64_t count) const {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+            << (total_steps ? 100.0 * static_cast<double>(count) / static_cast<double>(total_steps) : 0.0) << "%";
+        return ss.str();
+    }
+
+    static std::string CsvField(const std::string& value) {
+        if (value.find_first_of(",\"\n ") == std::string::npos) {
+            return value;
+        }
+        std::string result = "\"";
+        for (char c : value) {
+            if (c == '"') result += '"';
+            result += c;
+        }
+        return result + "\"";
+    }
+};
@@ -17,7 +17,7 @@
 
 class TapeCanvas : public wxPanel {
     const BidirectionalLazyTape<char>* tape = nullptr;
-    int headPos = 0;
+    int64_t headPos = 0;
     int tapeIndex = 0;
 
 public:
@@ -34,7 +34,7 @@ public:
         Unbind(wxEVT_SIZE, &TapeCanvas::OnResize, this);
     }
 
-    void UpdateData(const BidirectionalLazyTape<char>* t, int pos) {
+    void UpdateData(const BidirectionalLazyTape<char>* t, int64_t pos) {
         tape = t;
         headPos = pos;
         Refresh();
@@ -65,8 +65,8 @@ public:
         font.SetPointSize(12);
         dc.SetFont(font);
 
-        for (int i = headPos - half; i <= headPos + half; ++i) {
-            int x = (sz.GetWidth() / 2) - (cellW / 2) + (i - headPos) * cellW;
+        for (int64_t i = headPos - half; i <= headPos + half; ++i) {
+            int x = (sz.GetWidth() / 2) - (cellW / 2) + static_cast<int>(i - headPos) * cellW;
             int y = (sz.GetHeight() / 2) - (cellH / 2);
 
             if (i == headPos) {
@@ -80,7 +80,7 @@ public:
 
             dc.DrawRectangle(x, y, cellW, cellH);
 
-            char c = tape->Get(i);
+            char c = tape->Peek(i);
             wxString sym = wxString::Format("%c", c);
 
             wxSize textSz = dc.GetTextExtent(sym);
@@ -103,24 +103,14 @@ public:
 
 //  Главное окно
 class MainFrame : public wxFrame {
-    std::unique_ptr<MultiTapeTuringMachine> machine;
+    std::unique_ptr<TuringMachine> machine;
     wxTimer* timer;
 
-    struct StoredTransition {
-        std::string fromState;
-        std::string toState;
-        std::array<char, MultiTapeTuringMachine::MAX_TAPES> readSymbols;
-        std::array<char, MultiTapeTuringMachine::MAX_TAPES> writeSymbols;
-        std::array<int, MultiTapeTuringMachine::MAX_TAPES> moves;
-
-        StoredTransition() {
-            readSymbols.fill(' ');
-            writeSymbols.fill(' ');
-            moves.fill(0);
-        }
-    };
+    // Переход в том виде, в каком он пришёл из текста программы или из формы
+    using StoredTransition = TuringMachineCompiler::ParsedTransition;
 
     Sequence<StoredTransition> storedTransitions;
+    Sequence<TuringMachineCompiler::ParsedMachine> storedMachines;  // блоки machine из текста программы
 
     wxSpinCtrl* spinTapeCount;
     wxSlider* sliderSpeed;
@@ -223,7 +213,7 @@ public:
         wxBoxSizer* topSizer = new wxBoxSizer(wxHORIZONTAL);
 
         topSizer->Add(new wxStaticText(topPanel, wxID_ANY, "Number of Tapes:"), 0, wxALIGN_CENTER_VERTICAL | wxALL, 5);
-        spinTapeCount = new wxSpinCtrl(topPanel, ID_TAPE_COUNT, "1", wxDefaultPosition, wxSize(60, -1), wxSP_ARROW_KEYS, 1, 3, 1);
+        spinTapeCount = new wxSpinCtrl(topPanel, ID_TAPE_COUNT, "1", wxDefaultPosition, wxSize(60, -1), wxSP_ARROW_KEYS, 1, static_cast<int>(TuringMachine::MAX_TAPES), 1);
         topSizer->Add(spinTapeCount, 0, wxALIGN_CENTER_VERTICAL | wxALL, 5);
 
         topPanel->SetSizer(topSizer);
@@ -290,7 +280,7 @@ public:
         formGrid->Add(new wxStaticText(transPanel, wxID_ANY, ""), 0);
         formGrid->Add(new wxStaticText(transPanel, wxID_ANY, ""), 0);
 
-        for (size_t i = 0; i < MultiTapeTuringMachine::MAX_TAPES; ++i) {
+        for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
             formGrid->Add(new wxStaticText(transPanel, wxID_ANY, wxString::Format("Tape %zu Read:", i + 1)), 0, wxALIGN_CENTER_VERTICAL);
 
             auto* readEdit = new wxTextCtrl(transPanel, wxID_ANY, "", wxDefaultPosition, wxSize(50, -1));
@@ -330,12 +320,12 @@ public:
         wxStaticBoxSizer* tableGroup = new wxStaticBoxSizer(wxVERTICAL, transPanel, "Stored Transitions");
 
         transitionsGrid = new wxGrid(transPanel, ID_TRANSITIONS_GRID);
-        int colCount = 2 + 3 * static_cast<int>(MultiTapeTuringMachine::MAX_TAPES);
+        int colCount = 2 + 3 * static_cast<int>(TuringMachine::MAX_TAPES);
         transitionsGrid->CreateGrid(0, colCount);
 
         transitionsGrid->SetColLabelValue(0, "From");
         transitionsGrid->SetColLabelValue(1, "To");
-        for (size_t i = 0; i < MultiTapeTuringMachine::MAX_TAPES; ++i) {
+        for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
             transitionsGrid->SetColLabelValue(2 + 3 * i, wxString::Format("T%zu Read", i + 1));
             transitionsGrid->SetColLabelValue(3 + 3 * i, wxString::Format("T%zu Write", i + 1));
             transitionsGrid->SetColLabelValue(4 + 3 * i, wxString::Format("T%zu Move", i + 1));
@@ -381,6 +371,7 @@ public:
 
     void ClearAllTransitions() {
         storedTransitions.Clear();
+        storedMachines.Clear();
         int rows = transitionsGrid->GetNumberRows();
         if (rows > 0) {
             transitionsGrid->DeleteRows(0, rows);
@@ -416,16 +407,7 @@ public:
             }
 
             // Проверяем, может ли машина выполнить шаг
-            bool canStep = false;
-            try {
-                for (size_t i = 0; i < machine->GetActiveTapeCount(); ++i) {
-                    machine->GetSymbolAtHead(i);
-                }
-                canStep = true;
-            }
-            catch (...) {
-                canStep = false;
-            }
+            bool canStep = machine->CanStep();
 
             if (!canStep) {
                 // Если машина остановилась без явного accept/reject
@@ -517,18 +499,12 @@ public:
             machine.reset();
 
             // Создаем новую машину
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             // Восстанавливаем переходы
+            TuringMachineCompiler::AddMachines(*machine, storedMachines);
             for (size_t i = 0; i < storedTransitions.GetSize(); ++i) {
-                const auto& trans = storedTransitions[i];
-                machine->AddTransition(
-                    trans.fromState,
-                    trans.readSymbols,
-                    trans.toState,
-                    trans.writeSymbols,
-                    trans.moves
-                );
+                TuringMachineCompiler::AddToMachine(*machine, storedTransitions[i]);
             }
 
             // Восстанавливаем входные данные
@@ -550,7 +526,7 @@ public:
             wxMessageBox(e.what(), "Error Recreating Machine", wxICON_ERROR);
 
             // Создаем простую машину при ошибке
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
             UpdateUI();
         }
     }
@@ -622,15 +598,15 @@ public:
             return;
         }
 
-        std::array<char, MultiTapeTuringMachine::MAX_TAPES> readSyms;
-        std::array<char, MultiTapeTuringMachine::MAX_TAPES> writeSyms;
-        std::array<int, MultiTapeTuringMachine::MAX_TAPES> moves;
+        std::array<char, TuringMachine::MAX_TAPES> readSyms;
+        std::array<char, TuringMachine::MAX_TAPES> writeSyms;
+        std::array<int, TuringMachine::MAX_TAPES> moves;
 
         readSyms.fill(' ');
         writeSyms.fill(' ');
         moves.fill(0);
 
-        for (size_t i = 0; i < MultiTapeTuringMachine::MAX_TAPES; ++i) {
+        for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
             wxString readStr = readEdits[i]->GetValue();
             wxString writeStr = writeEdits[i]->GetValue();
             int moveIdx = moveChoices[i]->GetSelection();
@@ -654,6 +630,9 @@ public:
         trans.readSymbols = readSyms;
         trans.writeSymbols = writeSyms;
         trans.moves = moves;
+        for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
+            trans.readClasses[i] = SymbolClass::Single(readSyms[i]);
+        }
 
         // 1. Добавляем в storedTransitions
         storedTransitions.Append(trans);
@@ -674,18 +653,12 @@ public:
             machine.reset();
 
             // Создаем новую машину
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             // 4. Восстанавливаем все переходы из storedTransitions
+            TuringMachineCompiler::AddMachines(*machine, storedMachines);
             for (size_t i = 0; i < storedTransitions.GetSize(); ++i) {
-                const auto& t = storedTransitions[i];
-                machine->AddTransition(
-                    t.fromState,
-                    t.readSymbols,
-                    t.toState,
-                    t.writeSymbols,
-                    t.moves
-                );
+                TuringMachineCompiler::AddToMachine(*machine, storedTransitions[i]);
             }
 
             // 5. Восстанавливаем входные данные
@@ -701,7 +674,7 @@ public:
             transitionsGrid->SetCellValue(row, 1, toState);
 
             int col = 2;
-            for (size_t i = 0; i < MultiTapeTuringMachine::MAX_TAPES; ++i) {
+            for (size_t i = 0; i < TuringMachine::MAX_TAPES; ++i) {
                 char readChar = readSyms[i];
                 char writeChar = writeSyms[i];
                 int moveVal = moves[i];
@@ -727,7 +700,7 @@ public:
             wxMessageBox(e.what(), "Error", wxICON_ERROR);
 
             // Создаем простую машину при ошибке
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
             UpdateUI();
             lblStatus->SetLabel("Error - Transition Not Added");
         }
@@ -779,18 +752,12 @@ public:
             machine.reset();
 
             // Создаем новую машину
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             // 4. Восстанавливаем все переходы из storedTransitions
+            TuringMachineCompiler::AddMachines(*machine, storedMachines);
             for (size_t i = 0; i < storedTransitions.GetSize(); ++i) {
-                const auto& trans = storedTransitions[i];
-                machine->AddTransition(
-                    trans.fromState,
-                    trans.readSymbols,
-                    trans.toState,
-                    trans.writeSymbols,
-                    trans.moves
-                );
+                TuringMachineCompiler::AddToMachine(*machine, storedTransitions[i]);
             }
 
             // 5. Восстанавливаем входные данные
@@ -806,20 +773,28 @@ public:
         catch (const std::exception& e) {
             wxMessageBox(e.what(), "Error", wxICON_ERROR);
 
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
             UpdateUI();
             lblStatus->SetLabel("Error - Machine Reset");
         }
     }
 
+    // Один шаг без исключений: RunStatus::StepLimit с одним шагом означает, что машина может продолжать
+    RunResult StepOnce() {
+        RunOptions options;
+        options.max_steps = 1;
+        return machine->Run(options);
+    }
+
     void OnStep(wxCommandEvent& evt) {
         try {
-            bool moved = machine->ExecuteStep();
+            RunResult result = StepOnce();
             UpdateUI();
 
-            std::string currentState = machine->GetCurrentState();
-
-            if (!moved) {
+            if (result.steps == 0) {
+                if (result.status == RunStatus::StepLimit) {
+                    wxMessageBox("Maximum steps exceeded", "Error", wxICON_ERROR);
+                }
                 UpdateAcceptRejectStatus();
             }
         }
@@ -858,15 +833,15 @@ public:
         int count = spinTapeCount->GetValue();
 
         try {
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             machine->SetAcceptState("q_accept");
             machine->SetAcceptState("accept");
 
             // Восстанавливаем переходы
+            TuringMachineCompiler::AddMachines(*machine, storedMachines);
             for (size_t i = 0; i < storedTransitions.GetSize(); ++i) {
-                const auto& trans = storedTransitions[i];
-                machine->AddTransition(trans.fromState, trans.readSymbols, trans.toState, trans.writeSymbols, trans.moves);
+                TuringMachineCompiler::AddToMachine(*machine, storedTransitions[i]);
             }
 
             // Инициализируем ленты
@@ -880,7 +855,7 @@ public:
         }
         catch (const std::exception& e) {
             wxMessageBox(e.what(), "Reset Error", wxICON_ERROR);
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             machine->SetAcceptState("q_accept");
             machine->SetAcceptState("accept");
@@ -901,17 +876,17 @@ public:
 
     void OnTimer(wxTimerEvent& evt) {
         try {
-            std::string currentState = machine->GetCurrentState();
-
-
-            bool moved = machine->ExecuteStep();
+            RunResult result = StepOnce();
             UpdateUI();
 
-            currentState = machine->GetCurrentState();
+            std::string currentState = machine->GetCurrentState();
 
-            if (!moved || currentState == "q_accept" || currentState == "q_reject") {
+            if (result.steps == 0 || currentState == "q_accept" || currentState == "q_reject") {
                 timer->Stop();
                 btnRun->Enable();
+                if (result.steps == 0 && result.status == RunStatus::StepLimit) {
+                    wxMessageBox("Maximum steps exceeded", "Runtime Error");
+                }
                 UpdateAcceptRejectStatus();
             }
         }
@@ -929,8 +904,9 @@ public:
             int tapeCount = spinTapeCount->GetValue();
 
             std::string error;
+            Sequence<TuringMachineCompiler::ParsedMachine> compiledMachines;
             Sequence<TuringMachineCompiler::ParsedTransition> compiledTransitions =
-                TuringMachineCompiler::Compile(code, tapeCount, error);
+                TuringMachineCompiler::Compile(code, tapeCount, error, compiledMachines);
 
             if (!error.empty()) {
                 wxMessageBox(error, "Compilation Errors", wxICON_WARNING);
@@ -944,6 +920,7 @@ public:
 
             // 1. Очищаем storedTransitions
             storedTransitions.Clear();
+            storedMachines = compiledMachines;
 
             // 2. Очищаем таблицу
             int rows = transitionsGrid->GetNumberRows();
@@ -952,7 +929,7 @@ public:
             }
 
             // 3. Создаем новую машину
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", tapeCount);
+            machine = CreateTuringMachine("q0", tapeCount);
 
             // 4.Добавляем accept states
             machine->SetAcceptState("q_accept");
@@ -965,27 +942,15 @@ public:
             machine->SetAcceptState("end");
             machine->SetAcceptState("stop");
             machine->SetAcceptState("final");
+            TuringMachineCompiler::AddMachines(*machine, storedMachines);
 
             // 5. Добавляем переходы
             for (size_t i = 0; i < compiledTransitions.GetSize(); ++i) {
                 const auto& trans = compiledTransitions[i];
-                StoredTransition stored;
-                stored.fromState = trans.fromState;
-                stored.toState = trans.toState;
-                stored.readSymbols = trans.readSymbols;
-                stored.writeSymbols = trans.writeSymbols;
-                stored.moves = trans.moves;
-
-                storedTransitions.Append(stored);
+                storedTransitions.Append(trans);
 
                 // Добавляем переход в машину
-                machine->AddTransition(
-                    trans.fromState,
-                    trans.readSymbols,
-                    trans.toState,
-                    trans.writeSymbols,
-                    trans.moves
-                );
+                TuringMachineCompiler::AddToMachine(*machine, trans);
 
                 // Добавляем строку в таблицу
                 int row = transitionsGrid->GetNumberRows();
@@ -993,11 +958,17 @@ public:
 
                 transitionsGrid->SetCellValue(row, 0, wxString(trans.fromState));
                 transitionsGrid->SetCellValue(row, 1, wxString(trans.toState));
+                if (trans.IsCall()) {
+                    transitionsGrid->SetCellValue(row, 2, wxString("call " + trans.callMachine));
+                    continue;
+                }
 
                 int col = 2;
-                for (size_t j = 0; j < MultiTapeTuringMachine::MAX_TAPES; ++j) {
-                    transitionsGrid->SetCellValue(row, col++, wxString(1, trans.readSymbols[j]));
-                    transitionsGrid->SetCellValue(row, col++, wxString(1, trans.writeSymbols[j]));
+                for (size_t j = 0; j < TuringMachine::MAX_TAPES; ++j) {
+                    std::string write = trans.copyFrom[j] < 0 ? std::string(1, trans.writeSymbols[j])
+                        : trans.copyFrom[j] == static_cast<int>(j) ? "=" : "=" + std::to_string(trans.copyFrom[j] + 1);
+                    transitionsGrid->SetCellValue(row, col++, wxString(trans.readClasses[j].GetText()));
+                    transitionsGrid->SetCellValue(row, col++, wxString(write));
                     transitionsGrid->SetCellValue(row, col++, wxString::Format("%d", trans.moves[j]));
                 }
             }
@@ -1026,7 +997,7 @@ public:
 
             // Восстанавливаем машину при ошибке
             int count = spinTapeCount->GetValue();
-            machine = std::make_unique<MultiTapeTuringMachine>("q0", count);
+            machine = CreateTuringMachine("q0", count);
 
             // Устанавливаем accept states
             machine->SetAcceptState("q_accept");
@@ -1120,6 +1091,7 @@ public:
         machine.reset();
 
         storedTransitions.Clear();
+        storedMachines.Clear();
 
         tapeCanvases.Clear();
         inputEdits.Clear();
@@ -0,0 +1,637 @@
+#pragma once
+
+#include "Compiler.h"
+#include "multi_tape_turing_machine.h"
+#include "Sequence.h"
+#include "exceptions.h"
+#include "SymbolClass.h"
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+// Двоичный интерфейс между хостом и сгенерированным кодом.
+// Один и тот же текст компилируется здесь и вставляется в генерируемый исходник
+#define MMT_NATIVE_ABI \
+    struct MMTNativeTape { char* cells; unsigned char* dirty; int64_t lo; int64_t hi; int64_t head; }; \
+    struct MMTNativeContext { MMTNativeTape tapes[8]; uint32_t state; uint64_t steps; uint64_t limit; uint64_t budget; };
+
+#define MMT_NATIVE_STRINGIFY_IMPL(...) #__VA_ARGS__
+#define MMT_NATIVE_STRINGIFY(...) MMT_NATIVE_STRINGIFY_IMPL(__VA_ARGS__)
+
+MMT_NATIVE_ABI
+
+static_assert(TuringMachine::MAX_TAPES <= 8, "Native ABI supports up to 8 tapes");
+
+// Загруженная из разделяемой библиотеки программа машины.
+// Ленты передаются в машинный код окнами, которые расширяются по мере движения головок;
+// после выполнения изменённые ячейки записываются обратно через BidirectionalLazyTape::Set
+class NativeProgram {
+public:
+    using RunFunction = int (*)(MMTNativeContext*);
+
+    enum NativeStatus {
+        NATIVE_ACCEPTED = 0,
+        NATIVE_HALTED = 1,
+        NATIVE_OUT_OF_BUDGET = 2,
+        NATIVE_NEED_TAPE = 3
+    };
+
+private:
+    struct Window {
+        std::vector<char> cells;
+        std::vector<unsigned char> dirty;
+        int64_t lo = 0;
+    };
+
+    static constexpr int64_t WINDOW_MARGIN = 4096;
+
+    void* handle;
+    RunFunction run;
+    Sequence<std::string> state_names;
+    std::unordered_map<std::string, uint32_t> state_ids;
+    size_t tape_count;
+    uint64_t program_hash;
+
+public:
+    NativeProgram(void* library, RunFunction function, const char* const* names,
+        unsigned state_count, unsigned tapes, uint64_t hash)
+        : handle(library), run(function), tape_count(tapes), program_hash(hash) {
+        for (unsigned i = 0; i < state_count; ++i) {
+            state_names.Append(names[i]);
+            state_ids.emplace(names[i], i);
+        }
+    }
+
+    NativeProgram(const NativeProgram&) = delete;
+    NativeProgram& operator=(const NativeProgram&) = delete;
+
+    ~NativeProgram() {
+#ifndef _WIN32
+        if (handle) {
+            dlclose(handle);
+        }
+#endif
+    }
+
+    size_t GetTapeCount() const {
+        return tape_count;
+    }
+
+    uint64_t GetProgramHash() const {
+        return program_hash;
+    }
+
+    // Выполнить машину до останова. Семантика совпадает с TuringMachine::Run
+    bool Run(TuringMachine& machine,
+        size_t max_steps_override = std::numeric_limits<size_t>::max()) const {
+        if (machine.GetActiveTapeCount() != tape_count) {
+            throw InvalidArgumentException("Native program was compiled for a different number of tapes");
+        }
+
+        auto state_it = state_ids.find(machine.GetCurrentState());
+        if (state_it == state_ids.end()) {
+            throw InvalidStateException("State is not part of the native program: " + machine.GetCurrentState());
+        }
+
+        Sequence<Window> windows(tape_count);
+        MMTNativeContext ctx = {};
+        for (size_t i = 0; i < tape_count; ++i) {
+            int64_t head = machine.GetHeadPosition(i);
+            LoadWindow(machine, i, windows[i], head - WINDOW_MARGIN, head + WINDOW_MARGIN);
+            BindWindow(windows[i], ctx.tapes[i]);
+            ctx.tapes[i].head = head;
+        }
+        ctx.state = state_it->second;
+
+        size_t max_remaining = machine.GetMaxSteps() - machine.GetStepCount();
+        size_t done = 0;
+        int status;
+        while (true) {
+            ctx.steps = 0;
+            ctx.limit = max_steps_override - done;
+            ctx.budget = std::min(max_steps_override, max_remaining) - done;
+            status = run(&ctx);
+            done += ctx.steps;
+
+            if (status != NATIVE_NEED_TAPE) {
+                break;
+            }
+            for (size_t i = 0; i < tape_count; ++i) {
+                int64_t head = ctx.tapes[i].head;
+                if (head < ctx.tapes[i].lo || head >= ctx.tapes[i].hi) {
+                    GrowWindow(machine, i, windows[i], head);
+                    BindWindow(windows[i], ctx.tapes[i]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < tape_count; ++i) {
+            StoreWindow(machine, i, windows[i]);
+            machine.SetHeadPosition(i, ctx.tapes[i].head);
+        }
+        machine.SetCurrentState(state_names[ctx.state]);
+        machine.AdvanceStepCount(done);
+
+        if (status == NATIVE_ACCEPTED) return true;
+        if (status == NATIVE_HALTED) return false;
+        throw std::runtime_error("Maximum steps exceeded");
+    }
+
+private:
+    static void BindWindow(Window& w, MMTNativeTape& t) {
+        t.cells = w.cells.data();
+        t.dirty = w.dirty.data();
+        t.lo = w.lo;
+        t.hi = w.lo + static_cast<int64_t>(w.cells.size());
+    }
+
+    // Окно читается без материализации
+    static char Fetch(const BidirectionalLazyTape<char>& tape, int64_t index) {
+        return tape.Peek(index);
+    }
+
+    static void LoadWindow(TuringMachine& machine, size_t tape_idx, Window& w,
+        int64_t from, int64_t to) {
+        const BidirectionalLazyTape<char>& tape = *machine.GetTape(tape_idx);
+
+        w.lo = from;
+        w.cells.resize(static_cast<size_t>(to - from));
+        w.dirty.assign(w.cells.size(), 0);
+        for (int64_t i = from; i < to; ++i) {
+            w.cells[static_cast<size_t>(i - from)] = Fetch(tape, i);
+        }
+    }
+
+    static void GrowWindow(TuringMachine& machine, size_t tape_idx, Window& w, int64_t head) {
+        const BidirectionalLazyTape<char>& tape = *machine.GetTape(tape_idx);
+
+        int64_t old_lo = w.lo;
+        int64_t old_hi = w.lo + static_cast<int64_t>(w.cells.size());
+        int64_t extra = std::max<int64_t>(WINDOW_MARGIN, old_hi - old_lo);
+        int64_t new_lo = head < old_lo ? std::min(head, old_lo - extra) : old_lo;
+        int64_t new_hi = head >= old_hi ? std::max(head + 1, old_hi + extra) : old_hi;
+
+        Window grown;
+        grown.lo = new_lo;
+        grown.cells.resize(static_cast<size_t>(new_hi - new_lo));
+        grown.dirty.assign(grown.cells.size(), 0);
+        for (int64_t i = new_lo; i < new_hi; ++i) {
+            size_t at = static_cast<size_t>(i - new_lo);
+            if (i >= old_lo && i < old_hi) {
+                grown.cells[at] = w.cells[static_cast<size_t>(i - old_lo)];
+                grown.dirty[at] = w.dirty[static_cast<size_t>(i - old_lo)];
+            }
+            else {
+                grown.cells[at] = Fetch(tape, i);
+            }
+        }
+        w = std::move(grown);
+    }
+
+    static void StoreWindow(TuringMachine& machine, size_t tape_idx, const Window& w) {
+        BidirectionalLazyTape<char>* tape = machine.GetMutableTape(tape_idx);
+        for (size_t i = 0; i < w.cells.size(); ++i) {
+            if (w.dirty[i]) {
+                tape->Set(w.lo + static_cast<int64_t>(i), w.cells[i]);
+            }
+        }
+    }
+};
+
+// Трансляция программы в C++, компиляция системным компилятором и загрузка через dlopen.
+// Готовые библиотеки кэшируются по хэшу программы: в памяти процесса и в каталоге на диске
+class NativeMachineCompiler {
+public:
+    using ParsedTransition = TuringMachineCompiler::ParsedTransition;
+
+    static std::string GenerateSource(const Sequence<ParsedTransition>& transitions,
+        int tapeCount,
+        const std::string& startState,
+        const Sequence<std::string>& acceptStates,
+        char blank = ' ') {
+        if (tapeCount < 1 || tapeCount > static_cast<int>(TuringMachine::MAX_TAPES)) {
+            throw InvalidArgumentException("Invalid number of tapes");
+        }
+        size_t n = static_cast<size_t>(tapeCount);
+
+        // Как и в машине, повторный переход с тем же ключом заменяет предыдущий
+        std::map<std::string, uint32_t> ids;
+        Sequence<std::string> names;
+        auto intern = [&](const std::string& name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+            uint32_t id = static_cast<uint32_t>(names.GetSize());
+            ids.emplace(name, id);
+            names.Append(name);
+            return id;
+        };
+
+        intern(startState);
+        std::map<std::pair<uint32_t, uint64_t>, size_t> table;
+        std::vector<size_t> patterns;
+        for (size_t i = 0; i < transitions.GetSize(); ++i) {
+            const ParsedTransition& t = transitions[i];
+            if (t.IsCall()) {
+                throw InvalidArgumentException("Sub-machine calls are not supported in native code");
+            }
+            uint32_t from = intern(t.fromState);
+            intern(t.toState);
+
+            bool pattern = t.IsPattern();
+            bool reachable = true;
+            for (size_t k = n; k < TuringMachine::MAX_TAPES; ++k) {
+                if (pattern ? !t.readClasses[k].Contains(blank) : t.readSymbols[k] != blank) reachable = false;
+            }
+            if (reachable && pattern) {
+                patterns.push_back(i);
+            }
+            else if (reachable) {
+                table[{ from, SymbolKey(t.readSymbols, n) }] = i;
+            }
+        }
+
+        // С классами символов переключатель идёт по номерам классов эквивалентности,
+        // без них - прямо по символам
+        std::array<SymbolPartition, TuringMachine::MAX_TAPES> partitions;
+        if (!patterns.empty()) {
+            for (const auto& entry : table) {
+                for (size_t k = 0; k < n; ++k) {
+                    partitions[k].Refine(SymbolClass::Single(transitions[entry.second].readSymbols[k]));
+                }
+            }
+            for (size_t i : patterns) {
+                for (size_t k = 0; k < n; ++k) {
+                    partitions[k].Refine(transitions[i].readClasses[k]);
+                }
+            }
+
+            std::map<std::pair<uint32_t, uint64_t>, size_t> classes;
+            for (const auto& entry : table) {
+                std::array<char, TuringMachine::MAX_TAPES> symbols = transitions[entry.second].readSymbols;
+                uint64_t key = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    key |= uint64_t(partitions[k].GetTable()[static_cast<unsigned char>(symbols[k])]) << (8 * k);
+                }
+                classes[{ entry.first.first, key }] = entry.second;
+            }
+            // Обычные переходы имеют приоритет, среди переходов с классами - первый
+            for (size_t i : patterns) {
+                uint32_t from = ids.at(transitions[i].fromState);
+                std::vector<uint64_t> keys = { 0 };
+                for (size_t k = 0; k < n; ++k) {
+                    std::vector<uint16_t> members = partitions[k].ClassesIn(transitions[i].readClasses[k]);
+                    if (keys.size() * members.size() > MAX_PATTERN_CASES) {
+                        throw InvalidArgumentException("Symbol classes of " + transitions[i].fromState +
+                            " are too wide for native code");
+                    }
+                    std::vector<uint64_t> next;
+                    for (uint64_t key : keys) {
+                        for (uint16_t c : members) next.push_back(key | (uint64_t(c) << (8 * k)));
+                    }
+                    keys.swap(next);
+                }
+                for (uint64_t key : keys) {
+                    classes.emplace(std::make_pair(from, key), i);
+                }
+            }
+            table.swap(classes);
+        }
+
+        std::set<uint32_t> accepting;
+        for (size_t i = 0; i < acceptStates.GetSize(); ++i) {
+            accepting.insert(intern(acceptStates[i]));
+        }
+
+        std::ostringstream src;
+        src << "// Generated by NativeMachineCompiler\n"
+            << "#include <cstdint>\n"
+            << MMT_NATIVE_STRINGIFY(MMT_NATIVE_ABI) << "\n"
+            << "extern \"C\" {\n"
+            << "extern const unsigned mmt_tape_count = " << n << ";\n"
+            << "extern const unsigned mmt_state_count = " << names.GetSize() << ";\n"
+            << "extern const char* const mmt_state_names[] = {";
+        for (size_t i = 0; i < names.GetSize(); ++i) {
+            src << (i ? ", " : "") << QuoteString(names[i]);
+        }
+        src << "};\n\n";
+        if (!patterns.empty()) {
+            for (size_t k = 0; k < n; ++k) {
+                src << "static const unsigned char mmt_class" << k << "[256] = {";
+                for (size_t c = 0; c < 256; ++c) {
+                    src << (c ? "," : "") << partitions[k].GetTable()[c];
+                }
+                src << "};\n";
+            }
+            src << "\n";
+        }
+        src
+            << "int mmt_run(MMTNativeContext* ctx) {\n";
+        for (size_t k = 0; k < n; ++k) {
+            src << "    char* c" << k << " = ctx->tapes[" << k << "].cells;\n"
+                << "    unsigned char* d" << k << " = ctx->tapes[" << k << "].dirty;\n"
+                << "    const int64_t lo" << k << " = ctx->tapes[" << k << "].lo;\n"
+                << "    const int64_t hi" << k << " = ctx->tapes[" << k << "].hi;\n"
+                << "    int64_t h" << k << " = ctx->tapes[" << k << "].head;\n";
+        }
+        src << "    const uint64_t limit = ctx->limit;\n"
+            << "    const uint64_t budget = ctx->budget;\n"
+            << "    uint64_t steps = 0;\n"
+            << "    int status = 1;\n"
+            << "    switch (ctx->state) {\n";
+        for (size_t s = 0; s < names.GetSize(); ++s) {
+            src << "    case " << s << ": goto S" << s << ";\n";
+        }
+        src << "    default: goto done;\n"
+            << "    }\n";
+
+        for (uint32_t s = 0; s < names.GetSize(); ++s) {
+            src << "S" << s << ":\n";
+            if (accepting.count(s)) {
+                src << "    ctx->state = " << s << ";\n"
+                    << "    status = steps >= limit ? 2 : 0;\n"
+                    << "    goto done;\n";
+                continue;
+            }
+
+            src << "    if (steps == budget) { ctx->state = " << s << "; status = 2; goto done; }\n";
+
+            auto first = table.lower_bound({ s, 0 });
+            if (first == table.end() || first->first.first != s) {
+                src << "    ctx->state = " << s << ";\n"
+                    << "    status = 1;\n"
+                    << "    goto done;\n";
+                continue;
+            }
+
+            src << "    if (";
+            for (size_t k = 0; k < n; ++k) {
+                src << (k ? " || " : "") << "h" << k << " < lo" << k << " || h" << k << " >= hi" << k;
+            }
+            src << ") { ctx->state = " << s << "; status = 3; goto done; }\n"
+                << "    switch (";
+            for (size_t k = 0; k < n; ++k) {
+                std::string cell = "(unsigned char)c" + std::to_string(k) + "[h" + std::to_string(k) + " - lo" + std::to_string(k) + "]";
+                if (!patterns.empty()) {
+                    cell = "mmt_class" + std::to_string(k) + "[" + cell + "]";
+                }
+                src << (k ? " | " : "") << "(uint64_t)" << cell;
+                if (k) src << " << " << (8 * k);
+            }
+            src << ") {\n";
+
+            for (auto it = first; it != table.end() && it->first.first == s; ++it) {
+                const ParsedTransition& t = transitions[it->second];
+                bool copies = false;
+                for (size_t k = 0; k < n; ++k) {
+                    copies = copies || t.copyFrom[k] >= 0;
+                }
+                src << "    case " << it->first.second << "ull:" << (copies ? " {" : "") << "\n";
+                // Копируемые символы читаются до записи
+                for (size_t k = 0; k < n; ++k) {
+                    bool copied = false;
+                    for (size_t j = 0; j < n; ++j) {
+                        copied = copied || t.copyFrom[j] == static_cast<int>(k);
+                    }
+                    if (copied) {
+                        src << "        const char r" << k << " = c" << k << "[h" << k << " - lo" << k << "];\n";
+                    }
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    std::string value = t.copyFrom[k] >= 0 ? "r" + std::to_string(t.copyFrom[k])
+                        : std::to_string(static_cast<int>(static_cast<signed char>(t.writeSymbols[k])));
+                    src << "        c" << k << "[h" << k << " - lo" << k << "] = " << value << ";\n"
+                        << "        d" << k << "[h" << k << " - lo" << k << "] = 1;\n";
+                    if (t.moves[k] != 0) {
+                        src << "        h" << k << " += " << t.moves[k] << ";\n";
+                    }
+                }
+                src << "        ++steps;\n"
+                    << "        goto S" << ids.at(t.toState) << ";\n";
+                if (copies) {
+                    src << "    }\n";
+                }
+            }
+            src << "    default:\n"
+                << "        ctx->state = " << s << ";\n"
+                << "        status = 1;\n"
+                << "        goto done;\n"
+                << "    }\n";
+        }
+
+        src << "done:\n";
+        for (size_t k = 0; k < n; ++k) {
+            src << "    ctx->tapes[" << k << "].head = h" << k << ";\n";
+        }
+        src << "    ctx->steps = steps;\n"
+            << "    return status;\n"
+            << "}\n"
+            << "}\n";
+        return src.str();
+    }
+
+    // Собрать (или взять из кэша) машинный код программы
+    static std::shared_ptr<NativeProgram> Build(const Sequence<ParsedTransition>& transitions,
+        int tapeCount,
+        const std::string& startState,
+        const Sequence<std::string>& acceptStates,
+        std::string& error,
+        char blank = ' ') {
+        error.clear();
+        std::string source;
+        try {
+            source = GenerateSource(transitions, tapeCount, startState, acceptStates, blank);
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+            return nullptr;
+        }
+        uint64_t hash = HashSource(source);
+
+        static std::mutex cache_mutex;
+        static std::map<uint64_t, std::weak_ptr<NativeProgram>> loaded;
+        std::lock_guard<std::mutex> lock(cache_mutex);
+
+        auto cached = loaded.find(hash);
+        if (cached != loaded.end()) {
+            if (auto program = cached->second.lock()) {
+                return program;
+            }
+        }
+
+#ifdef _WIN32
+        error = "Native code generation is not supported on this platform";
+        return nullptr;
+#else
+        std::error_code ec;
+        std::filesystem::path dir = CacheDirectory();
+        std::filesystem::create_directories(dir.parent_path(), ec);
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            error = "Cannot create cache directory " + dir.string() + ": " + std::strerror(errno);
+            return nullptr;
+        }
+        // Загружаемый код берётся только из своего каталога, куда не могут писать другие
+        if (!IsPrivate(dir, S_IFDIR)) {
+            error = "Cache directory " + dir.string() + " must belong to the current user and be writable only by them";
+            return nullptr;
+        }
+
+        std::string stem = "tm_" + ToHex(hash);
+        std::filesystem::path library = dir / (stem + ".so");
+
+        if (!std::filesystem::exists(library)) {
+            // Исходник и журнал со своими именами: параллельные сборки не мешают друг другу
+            std::string cpp_name = (dir / (stem + ".XXXXXX")).string();
+            int fd = mkstemp(&cpp_name[0]);
+            if (fd < 0) {
+                error = "Cannot create source file in " + dir.string();
+                return nullptr;
+            }
+            std::filesystem::path cpp = cpp_name;
+            std::filesystem::path log = cpp_name + ".log";
+            std::filesystem::path temp = dir / (stem + ".so." + std::to_string(getpid()));
+            bool written = static_cast<size_t>(write(fd, source.data(), source.size())) == source.size();
+            close(fd);
+            if (!written) {
+                std::filesystem::remove(cpp, ec);
+                error = "Cannot write " + cpp.string();
+                return nullptr;
+            }
+
+            const char* cxx = std::getenv("MMT_CXX");
+            std::string command = std::string(cxx ? cxx : "c++") +
+                " -std=c++17 -O2 -shared -fPIC -o \"" + temp.string() + "\" -x c++ \"" + cpp.string() +
+                "\" > \"" + log.string() + "\" 2>&1";
+            bool compiled = std::system(command.c_str()) == 0;
+            std::stringstream messages;
+            if (!compiled) {
+                std::ifstream in(log);
+                messages << in.rdbuf();
+            }
+            std::filesystem::remove(cpp, ec);
+            std::filesystem::remove(log, ec);
+            if (!compiled) {
+                std::filesystem::remove(temp, ec);
+                error = "Native compilation failed:\n" + messages.str();
+                return nullptr;
+            }
+            std::filesystem::rename(temp, library, ec);
+            if (ec) {
+                error = "Cannot store " + library.string() + ": " + ec.message();
+                return nullptr;
+            }
+        }
+        if (!IsPrivate(library, S_IFREG)) {
+            error = "Native program " + library.string() + " must belong to the current user and be writable only by them";
+            return nullptr;
+        }
+
+        void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            error = std::string("dlopen failed: ") + dlerror();
+            return nullptr;
+        }
+
+        auto run = reinterpret_cast<NativeProgram::RunFunction>(dlsym(handle, "mmt_run"));
+        auto names = static_cast<const char* const*>(dlsym(handle, "mmt_state_names"));
+        auto state_count = static_cast<const unsigned*>(dlsym(handle, "mmt_state_count"));
+        auto tape_count = static_cast<const unsigned*>(dlsym(handle, "mmt_tape_count"));
+        if (!run || !names || !state_count || !tape_count) {
+            error = "Invalid native program " + library.string();
+            dlclose(handle);
+            return nullptr;
+        }
+
+        auto program = std::make_shared<NativeProgram>(handle, run, names, *state_count, *tape_count, hash);
+        loaded[hash] = program;
+        return program;
+#endif
+    }
+
+    // Каталог кэша: MMT_NATIVE_CACHE, иначе свой каталог пользователя
+    // ($XDG_CACHE_HOME или ~/.cache), а без них - временный каталог с номером пользователя
+    static std::filesystem::path CacheDirectory() {
+        const char* dir = std::getenv("MMT_NATIVE_CACHE");
+        if (dir && *dir) {
+            return dir;
+        }
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        if (xdg && *xdg) {
+            return std::filesystem::path(xdg) / "mmt_native";
+        }
+        const char* home = std::getenv("HOME");
+        if (home && *home) {
+            return std::filesystem::path(home) / ".cache" / "mmt_native";
+        }
+#ifdef _WIN32
+        return std::filesystem::temp_directory_path() / "mmt_native_cache";
+#else
+        return std::filesystem::temp_directory_path() / ("mmt_native_cache-" + std::to_string(getuid()));
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    // Файл нужного типа принадлежит текущему пользователю, и больше никто не может в него писать
+    static bool IsPrivate(const std::filesystem::path& path, mode_t type) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == type &&
+            info.st_uid == getuid() && (info.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+    }
+#endif
+
+    // Сколько вариантов switch может дать один переход с классами
+    static constexpr size_t MAX_PATTERN_CASES = size_t(1) << 16;
+
+    static uint64_t SymbolKey(const std::array<char, TuringMachine::MAX_TAPES>& symbols, size_t n) {
+        uint64_t key = 0;
+        for (size_t k = 0; k < n; ++k) {
+            key |= static_cast<uint64_t>(static_cast<unsigned char>(symbols[k])) << (8 * k);
+        }
+        return key;
+    }
+
+    // FNV-1a
+    static uint64_t HashSource(const std::string& source) {
+        uint64_t hash = 1469598103934665603ull;
+        for (unsigned char c : source) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string ToHex(uint64_t value) {
+        static const char digits[] = "0123456789abcdef";
+        std::string result(16, '0');
+        for (int i = 15; i >= 0; --i) {
+            result[static_cast<size_t>(i)] = digits[value & 15];
+            value >>= 4;
+        }
+        return result;
+    }
+
+    static std::string QuoteString(const std::string& text) {
+        std::string result = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result + "\"";
+    }
+};
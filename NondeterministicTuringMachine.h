@@ -0,0 +1,471 @@
+#pragma once
+
+#include "multi_tape_turing_machine.h"
+#include "ThreadPool.h"
+#include "Sequence.h"
+#include "exceptions.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <vector>
+#include <array>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+// Лента с копированием при записи: содержимое разбито на блоки, блоки и их каталог
+// разделяются между ветвями вычисления и копируются только при записи в общий блок
+class CowTape {
+private:
+    static constexpr int CHUNK_SIZE = 64;
+    using Chunk = std::array<char, CHUNK_SIZE>;
+
+    struct Directory {
+        int64_t first = 0;  // номер первого блока
+        std::vector<std::shared_ptr<Chunk>> chunks;  // nullptr - блок из пустых символов
+    };
+
+    std::shared_ptr<Directory> directory;
+    char blank_symbol;
+    uint64_t content_hash;  // сумма хэшей непустых ячеек
+
+    static int64_t ChunkOf(int64_t index) {
+        return index >= 0 ? index / CHUNK_SIZE : -((-(index + 1)) / CHUNK_SIZE) - 1;
+    }
+
+    uint64_t CellHash(int64_t index, char value) const {
+        if (value == blank_symbol) return 0;
+        uint64_t x = (static_cast<uint64_t>(index) << 8) ^
+            static_cast<unsigned char>(value);
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // Каталог, принадлежащий только этой ленте
+    Directory& MutableDirectory() {
+        if (!directory) {
+            directory = std::make_shared<Directory>();
+        }
+        else if (directory.use_count() > 1) {
+            directory = std::make_shared<Directory>(*directory);
+        }
+        return *directory;
+    }
+
+public:
+    CowTape(char blank = ' ')
+        : blank_symbol(blank), content_hash(0) {
+    }
+
+    void Initialize(const std::string& input) {
+        directory.reset();
+        content_hash = 0;
+        for (size_t i = 0; i < input.length(); ++i) {
+            Set(static_cast<int64_t>(i), input[i]);
+        }
+    }
+
+    char Get(int64_t index) const {
+        if (!directory) {
+            return blank_symbol;
+        }
+        int64_t chunk = ChunkOf(index) - directory->first;
+        if (chunk < 0 || chunk >= static_cast<int64_t>(directory->chunks.size()) || !directory->chunks[chunk]) {
+            return blank_symbol;
+        }
+        return (*directory->chunks[chunk])[index - ChunkOf(index) * CHUNK_SIZE];
+    }
+
+    void Set(int64_t index, char value) {
+        char old = Get(index);
+        if (old == value) {
+            return;
+        }
+        content_hash += CellHash(index, value) - CellHash(index, old);
+
+        Directory& dir = MutableDirectory();
+        int64_t chunk_no = ChunkOf(index);
+        if (dir.chunks.empty()) {
+            dir.first = chunk_no;
+        }
+        if (chunk_no < dir.first) {
+            // Расширяем с запасом, чтобы движение влево не копировало каталог на каждом блоке
+            int64_t grow = std::max(dir.first - chunk_no, static_cast<int64_t>(dir.chunks.size()));
+            dir.chunks.insert(dir.chunks.begin(), static_cast<size_t>(grow), nullptr);
+            dir.first -= grow;
+        }
+        size_t at = static_cast<size_t>(chunk_no - dir.first);
+        if (at >= dir.chunks.size()) {
+            dir.chunks.resize(at + 1);
+        }
+
+        std::shared_ptr<Chunk>& chunk = dir.chunks[at];
+        if (!chunk) {
+            chunk = std::make_shared<Chunk>();
+            chunk->fill(blank_symbol);
+        }
+        else if (chunk.use_count() > 1) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        (*chunk)[index - chunk_no * CHUNK_SIZE] = value;
+    }
+
+    uint64_t GetContentHash() const {
+        return content_hash;
+    }
+
+    std::string GetContent(int64_t from, int64_t to) const {
+        std::string result;
+        for (int64_t i = from; i <= to; ++i) {
+            result += Get(i);
+        }
+        return result;
+    }
+};
+
+// Множество хэшей для нескольких потоков: сегменты со своими мьютексами
+class ConcurrentHashSet {
+private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<uint64_t> items;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+    std::atomic<size_t> count;
+
+public:
+    ConcurrentHashSet() : count(0) {}
+
+    // true, если значения ещё не было
+    bool Insert(uint64_t value) {
+        Shard& shard = shards[(value >> 32) % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.items.insert(value).second) {
+            return false;
+        }
+        count++;
+        return true;
+    }
+
+    size_t GetSize() const {
+        return count;
+    }
+};
+
+// Недетерминированная машина Тьюринга: из одной конфигурации может быть несколько переходов.
+// Конфигурации обходятся в ширину на пуле потоков, повторы отсекаются по хэшу конфигурации,
+// поиск прекращается на первой допускающей ветви
+class NondeterministicTuringMachine {
+public:
+    static constexpr size_t MAX_TAPES = TuringMachine::MAX_TAPES;
+
+private:
+    struct CompiledTransition {
+        uint32_t state_to;
+        std::array<char, MAX_TAPES> write_symbols;
+        std::array<int, MAX_TAPES> moves;
+    };
+
+    struct Configuration {
+        uint32_t state;
+        std::array<int64_t, MAX_TAPES> heads;
+        std::array<CowTape, MAX_TAPES> tapes;
+        uint64_t hash;
+    };
+
+    // Конфигураций на одну задачу пула
+    static constexpr size_t CHUNK_SIZE = 64;
+
+    std::vector<TuringMachine::Transition> transitions;
+    std::map<std::string, uint32_t> state_ids;
+    std::vector<std::string> state_names;
+    std::vector<uint64_t> accept_bitmap;
+    std::vector<std::unordered_map<uint64_t, std::vector<CompiledTransition>>> table;  // по состояниям
+    bool table_dirty;
+    uint32_t start_state;
+    char blank_symbol;
+    size_t active_tapes;
+    size_t max_steps;
+    size_t max_configurations;
+    std::array<std::string, MAX_TAPES> inputs;
+    Configuration result;  // допускающая конфигурация после успешного Run, иначе начальная
+    size_t step_count;
+    size_t explored;
+
+public:
+    NondeterministicTuringMachine(const std::string& start,
+        size_t num_tapes = 1,
+        char blank = ' ',
+        size_t max_steps_limit = 1000000)
+        : table_dirty(true),
+        start_state(0),
+        blank_symbol(blank),
+        active_tapes(num_tapes),
+        max_steps(max_steps_limit),
+        max_configurations(size_t(1) << 24),
+        step_count(0),
+        explored(0) {
+        if (num_tapes < 1 || num_tapes > MAX_TAPES) {
+            throw std::invalid_argument("Number of tapes must be between 1 and " + std::to_string(MAX_TAPES));
+        }
+        start_state = InternState(start);
+        result = InitialConfiguration();
+    }
+
+    // Добавить переход; переходы с одинаковым (состояние, символы) не заменяют друг друга
+    void AddTransition(const std::string& from,
+        const std::array<char, MAX_TAPES>& read,
+        const std::string& to,
+        const std::array<char, MAX_TAPES>& write,
+        const std::array<int, MAX_TAPES>& moves) {
+        transitions.emplace_back(from, read, to, write, moves);
+        InternState(from);
+        InternState(to);
+        table_dirty = true;
+    }
+
+    void SetAcceptState(const std::string& state) {
+        uint32_t id = InternState(state);
+        accept_bitmap[id >> 6] |= uint64_t(1) << (id & 63);
+    }
+
+    void InitializeTape(size_t tape_idx, const std::string& input) {
+        if (tape_idx >= active_tapes) {
+            throw InvalidTapeException();
+        }
+        inputs[tape_idx] = input;
+        result = InitialConfiguration();
+        step_count = 0;
+    }
+
+    void InitializeTapes(const Sequence<std::string>& new_inputs) {
+        if (new_inputs.GetSize() != active_tapes) {
+            throw std::invalid_argument("Number of inputs must match number of active tapes");
+        }
+        for (size_t i = 0; i < active_tapes; ++i) {
+            InitializeTape(i, new_inputs[i]);
+        }
+    }
+
+    // Предел числа различных конфигураций, после которого поиск прекращается
+    void SetMaxConfigurations(size_t limit) {
+        max_configurations = limit;
+    }
+
+    // true - какая-то ветвь допустила за минимальное число шагов, false - все ветви остановились.
+    // Бросает runtime_error при исчерпании лимита шагов или конфигураций.
+    // Совпадение хэшей разных конфигураций считается повтором
+    bool Run(size_t thread_count = 0) {
+        Compile();
+        Configuration initial = InitialConfiguration();
+        result = initial;
+        step_count = 0;
+        explored = 1;
+        if (IsAccepting(initial.state)) {
+            return true;
+        }
+
+        ConcurrentHashSet visited;
+        visited.Insert(initial.hash);
+        std::vector<Configuration> frontier;
+        frontier.push_back(std::move(initial));
+
+        WorkStealingPool pool(thread_count);
+        for (size_t depth = 0; !frontier.empty(); ++depth) {
+            if (depth >= max_steps) {
+                throw std::runtime_error("Maximum steps exceeded");
+            }
+
+            size_t chunks = (frontier.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            std::vector<std::vector<Configuration>> next(chunks);
+            std::atomic<bool> found(false);
+            std::mutex found_mutex;
+
+            for (size_t c = 0; c < chunks; ++c) {
+                pool.Submit([&, c] {
+                    size_t last = std::min(frontier.size(), (c + 1) * CHUNK_SIZE);
+                    for (size_t i = c * CHUNK_SIZE; i < last && !found; ++i) {
+                        Expand(frontier[i], visited, next[c], found, found_mutex);
+                    }
+                });
+            }
+            pool.Wait();
+
+            explored = visited.GetSize();
+            if (found) {
+                step_count = depth + 1;
+                return true;
+            }
+            if (explored > max_configurations) {
+                throw std::runtime_error("Configuration limit exceeded");
+            }
+
+            frontier.clear();
+            for (auto& part : next) {
+                for (auto& config : part) {
+                    frontier.push_back(std::move(config));
+                }
+            }
+        }
+        return false;
+    }
+
+    // Число шагов до допускающей конфигурации
+    size_t GetStepCount() const {
+        return step_count;
+    }
+
+    // Число различных конфигураций, найденных при последнем Run
+    size_t GetExploredCount() const {
+        return explored;
+    }
+
+    size_t GetActiveTapeCount() const {
+        return active_tapes;
+    }
+
+    size_t GetTransitionCount() const {
+        return transitions.size();
+    }
+
+    std::string GetCurrentState() const {
+        return state_names[result.state];
+    }
+
+    std::string GetTapeContent(size_t tape_idx, int64_t from = -10, int64_t to = 10) const {
+        if (tape_idx >= active_tapes) {
+            throw InvalidTapeException();
+        }
+        return result.tapes[tape_idx].GetContent(from, to);
+    }
+
+    int64_t GetHeadPosition(size_t tape_idx) const {
+        if (tape_idx >= active_tapes) {
+            throw InvalidTapeException();
+        }
+        return result.heads[tape_idx];
+    }
+
+private:
+    static uint64_t MixHash(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    uint32_t InternState(const std::string& name) {
+        auto it = state_ids.find(name);
+        if (it != state_ids.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(state_names.size());
+        state_ids.emplace(name, id);
+        state_names.push_back(name);
+        if (accept_bitmap.size() * 64 <= id) {
+            accept_bitmap.push_back(0);
+        }
+        table_dirty = true;
+        return id;
+    }
+
+    bool IsAccepting(uint32_t state) const {
+        return (accept_bitmap[state >> 6] >> (state & 63)) & 1;
+    }
+
+    uint64_t PackSymbols(const std::array<char, MAX_TAPES>& symbols) const {
+        uint64_t key = 0;
+        for (size_t i = 0; i < active_tapes; ++i) {
+            key |= uint64_t(static_cast<unsigned char>(symbols[i])) << (8 * i);
+        }
+        return key;
+    }
+
+    uint64_t ConfigurationHash(const Configuration& config) const {
+        uint64_t hash = MixHash(config.state + 0x51ed270b27e5c3a1ull);
+        for (size_t i = 0; i < active_tapes; ++i) {
+            hash = MixHash(hash ^ config.tapes[i].GetContentHash());
+            hash = MixHash(hash ^ static_cast<uint64_t>(config.heads[i]));
+        }
+        return hash;
+    }
+
+    Configuration InitialConfiguration() const {
+        Configuration config;
+        config.state = start_state;
+        config.heads.fill(0);
+        for (size_t i = 0; i < active_tapes; ++i) {
+            config.tapes[i] = CowTape(blank_symbol);
+            config.tapes[i].Initialize(inputs[i]);
+        }
+        config.hash = ConfigurationHash(config);
+        return config;
+    }
+
+    // Таблица: состояние -> упакованные символы -> все переходы с этим ключом
+    void Compile() {
+        if (!table_dirty) {
+            return;
+        }
+        table.assign(state_names.size(), {});
+        for (const auto& t : transitions) {
+            bool reachable = true;
+            for (size_t i = active_tapes; i < MAX_TAPES; ++i) {
+                if (t.read_symbols[i] != blank_symbol && t.read_symbols[i] != 0) reachable = false;
+            }
+            if (!reachable) continue;
+
+            CompiledTransition ct;
+            ct.state_to = state_ids.at(t.state_to);
+            ct.write_symbols = t.write_symbols;
+            ct.moves = t.moves;
+            table[state_ids.at(t.state_from)][PackSymbols(t.read_symbols)].push_back(ct);
+        }
+        table_dirty = false;
+    }
+
+    void Expand(const Configuration& config, ConcurrentHashSet& visited,
+        std::vector<Configuration>& out, std::atomic<bool>& found, std::mutex& found_mutex) {
+        std::array<char, MAX_TAPES> symbols;
+        for (size_t i = 0; i < active_tapes; ++i) {
+            symbols[i] = config.tapes[i].Get(config.heads[i]);
+        }
+
+        const auto& row = table[config.state];
+        auto it = row.find(PackSymbols(symbols));
+        if (it == row.end()) {
+            return;  // ветвь остановилась
+        }
+
+        for (const CompiledTransition& t : it->second) {
+            Configuration child = config;
+            for (size_t i = 0; i < active_tapes; ++i) {
+                child.tapes[i].Set(child.heads[i], t.write_symbols[i]);
+                child.heads[i] += t.moves[i];
+            }
+            child.state = t.state_to;
+            child.hash = ConfigurationHash(child);
+
+            if (IsAccepting(child.state)) {
+                std::lock_guard<std::mutex> lock(found_mutex);
+                if (!found) {
+                    result = std::move(child);
+                    found = true;
+                }
+                return;
+            }
+            if (visited.Insert(child.hash)) {
+                out.push_back(std::move(child));
+            }
+        }
+    }
+};
@@ -0,0 +1,476 @@
+#pragma once
+
+#include "multi_tape_turing_machine.h"
+#include "exceptions.h"
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// Формат файла кэша (все числа little-endian):
+//   "MTMCACHE", версия, число записей;
+//   по записи - хэш программы, хэш входа, начальная конфигурация, статус, шагов, бюджет шагов,
+//   период цикла, конечное состояние, число лент; по ленте - головка, индекс первой ячейки,
+//   содержимое. Начальная конфигурация - состояние, флаг поиска циклов, число лент и ленты.
+// Записи идут от давно использованных к недавним, при загрузке порядок LRU сохраняется
+struct RunCacheOptions {
+    size_t max_bytes = size_t(64) << 20;  // предел памяти под записи
+    std::string path;                     // файл кэша; пустой - только в памяти
+};
+
+// Кэш результатов запуска: по хэшу скомпилированной программы и начальной конфигурации
+// (состояние, головки, содержимое лент) хранит статус, число шагов и конечные ленты.
+// Повторный вход не выполняется, а восстанавливается в машине копированием лент
+class RunCache {
+private:
+    static constexpr char MAGIC[9] = "MTMCACHE";
+    static constexpr uint32_t VERSION = 3;
+    // Накладные расходы на запись сверх содержимого лент: узел списка, индекс, строки
+    static constexpr size_t ENTRY_OVERHEAD = 256;
+
+    struct TapeImage {
+        int64_t head = 0;
+        int64_t first = 0;
+        std::string content;
+
+        bool operator==(const TapeImage& other) const {
+            return head == other.head && first == other.first && content == other.content;
+        }
+    };
+
+    // Начальная конфигурация запуска. Хэш входа только выбирает запись, совпадение
+    // проверяется по самой конфигурации: разные входы с одним хэшем не путаются
+    struct Start {
+        std::string state;
+        bool cycles = false;
+        std::vector<TapeImage> tapes;
+
+        bool operator==(const Start& other) const {
+            return state == other.state && cycles == other.cycles && tapes == other.tapes;
+        }
+
+        size_t Size() const {
+            size_t size = state.size();
+            for (const TapeImage& tape : tapes) {
+                size += sizeof(TapeImage) + tape.content.size();
+            }
+            return size;
+        }
+    };
+
+    struct Entry {
+        uint64_t program = 0;
+        uint64_t input = 0;
+        Start start;
+        RunStatus status = RunStatus::Halted;
+        size_t steps = 0;
+        size_t budget = 0;  // лимит шагов, при котором получен StepLimit
+        size_t cycle_period = 0;
+        std::string final_state;
+        std::vector<TapeImage> tapes;
+
+        size_t Size() const {
+            size_t size = ENTRY_OVERHEAD + start.Size() + final_state.size();
+            for (const TapeImage& tape : tapes) {
+                size += sizeof(TapeImage) + tape.content.size();
+            }
+            return size;
+        }
+    };
+
+    RunCacheOptions options;
+    std::list<Entry> entries;  // в начале - недавно использованные
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t used_bytes;
+    size_t hits;
+    size_t misses;
+    mutable std::mutex mutex;
+
+public:
+    explicit RunCache(const RunCacheOptions& opts = RunCacheOptions())
+        : options(opts),
+        used_bytes(0),
+        hits(0),
+        misses(0) {
+        if (!options.path.empty() && std::filesystem::exists(options.path)) {
+            Load();
+        }
+    }
+
+    RunCache(const RunCache&) = delete;
+    RunCache& operator=(const RunCache&) = delete;
+
+    ~RunCache() {
+        if (options.path.empty()) {
+            return;
+        }
+        try {
+            Save();
+        }
+        catch (...) {
+        }
+    }
+
+    // Запуск через кэш. Профилирование, запись трассы, журнал шагов и незавершённые вызовы
+    // вложенных машин требуют настоящего выполнения, такие запуски идут мимо кэша: восстановление
+    // из кэша не даёт шагов, и журнал сбросился бы. Мимо кэша идут и ленты с недочитанным
+    // потоковым входом: ключ по прочитанной части не различил бы входы
+    RunResult Run(TuringMachine& machine, const RunOptions& run_options = RunOptions()) {
+        if (machine.IsProfilingEnabled() || machine.HasStepSink() || machine.IsJournalEnabled() ||
+            machine.GetCallDepth() > 0) {
+            return machine.Run(run_options);
+        }
+        for (size_t i = 0; i < machine.GetActiveTapeCount(); ++i) {
+            if (!machine.GetTape(i)->IsInputComplete()) {
+                return machine.Run(run_options);
+            }
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        uint64_t program = machine.GetProgramHash();
+        bool cycles = run_options.detect_cycles || machine.IsCycleDetectionEnabled();
+        Start start = CaptureStart(machine, cycles);
+        uint64_t input = HashStart(start);
+        size_t budget = std::min(run_options.max_steps, machine.GetMaxSteps() - machine.GetStepCount());
+
+        RunResult result;
+        if (Restore(machine, program, input, start, budget, result)) {
+            result.elapsed = std::chrono::steady_clock::now() - started;
+            return result;
+        }
+
+        result = machine.Run(run_options);
+        if (result.status != RunStatus::Cancelled && machine.GetCallDepth() == 0) {
+            Store(machine, program, input, std::move(start), budget, result);
+        }
+        return result;
+    }
+
+    // Записать кэш в файл: сначала во временный, затем переименовать
+    void Save() const {
+        if (options.path.empty()) {
+            throw InvalidArgumentException("Run cache has no file");
+        }
+        std::string temp = options.path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                throw InvalidArgumentException("Cannot write run cache: " + temp);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            out.write(MAGIC, 8);
+            Put(out, VERSION, 4);
+            Put(out, entries.size(), 8);
+            for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+                WriteEntry(out, *it);
+            }
+            if (!out.flush()) {
+                throw std::runtime_error("Cannot write run cache: " + temp);
+            }
+        }
+        std::filesystem::rename(temp, options.path);
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+        used_bytes = 0;
+    }
+
+    size_t GetEntryCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    size_t GetMemoryUsage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used_bytes;
+    }
+
+    size_t GetHits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    size_t GetMisses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+private:
+    static uint64_t Mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // FNV-1a
+    static uint64_t HashText(const std::string& text) {
+        uint64_t hash = 1469598103934665603ull;
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint64_t Key(uint64_t program, uint64_t input) {
+        return Mix(program ^ Mix(input));
+    }
+
+    // Пустые ячейки по краям не влияют на выполнение, поэтому от лент остаётся только
+    // содержимое между первым и последним непустым символом
+    static Start CaptureStart(const TuringMachine& machine, bool cycles) {
+        char blank = machine.GetBlankSymbol();
+        Start start;
+        start.state = machine.GetCurrentState();
+        start.cycles = cycles;
+        for (size_t i = 0; i < machine.GetActiveTapeCount(); ++i) {
+            TapeImage image;
+            image.head = machine.GetHeadPosition(i);
+            image.content = machine.GetTape(i)->GetImage(image.first);
+            size_t begin = image.content.find_first_not_of(blank);
+            if (begin == std::string::npos) {
+                image.content.clear();
+                image.first = 0;
+            }
+            else {
+                image.content = image.content.substr(begin, image.content.find_last_not_of(blank) - begin + 1);
+                image.first += static_cast<int64_t>(begin);
+            }
+            start.tapes.push_back(std::move(image));
+        }
+        return start;
+    }
+
+    static uint64_t HashStart(const Start& start) {
+        uint64_t hash = Mix(HashText(start.state) ^ (start.cycles ? 1 : 0));
+        for (const TapeImage& image : start.tapes) {
+            hash = Mix(hash ^ static_cast<uint64_t>(image.head));
+            hash = Mix(hash ^ static_cast<uint64_t>(image.first));
+            hash = Mix(hash ^ HashText(image.content));
+        }
+        return hash;
+    }
+
+    // Запись годится, если запуск с текущим бюджетом закончился бы так же
+    static bool Applies(const Entry& entry, size_t budget) {
+        if (entry.status == RunStatus::StepLimit) {
+            return entry.budget == budget;
+        }
+        return entry.steps < budget;
+    }
+
+    bool Restore(TuringMachine& machine, uint64_t program, uint64_t input, const Start& start, size_t budget,
+        RunResult& result) {
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(Key(program, input));
+            if (found == index.end() || found->second->program != program ||
+                found->second->input != input || !(found->second->start == start) ||
+                !Applies(*found->second, budget)) {
+                misses++;
+                return false;
+            }
+            hits++;
+            entries.splice(entries.begin(), entries, found->second);
+            entry = *found->second;
+        }
+
+        for (size_t i = 0; i < entry.tapes.size(); ++i) {
+            const TapeImage& image = entry.tapes[i];
+            machine.GetMutableTape(i)->LoadImage(image.first, image.content);
+            machine.SetHeadPosition(i, image.head);
+        }
+        machine.SetCurrentState(entry.final_state);
+        machine.AdvanceStepCount(entry.steps);
+
+        result.status = entry.status;
+        result.steps = entry.steps;
+        result.cycle_period = entry.cycle_period;
+        return true;
+    }
+
+    void Store(const TuringMachine& machine, uint64_t program, uint64_t input, Start&& start, size_t budget,
+        const RunResult& result) {
+        Entry entry;
+        entry.program = program;
+        entry.input = input;
+        entry.start = std::move(start);
+        entry.status = result.status;
+        entry.steps = result.steps;
+        entry.budget = budget;
+        entry.cycle_period = result.cycle_period;
+        entry.final_state = machine.GetCurrentState();
+        for (size_t i = 0; i < machine.GetActiveTapeCount(); ++i) {
+            TapeImage image;
+            image.head = machine.GetHeadPosition(i);
+            image.content = machine.GetTape(i)->GetImage(image.first);
+            entry.tapes.push_back(std::move(image));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Insert(std::move(entry));
+    }
+
+    // Вставка с вытеснением давно использованных записей; запись больше предела не хранится
+    void Insert(Entry&& entry) {
+        size_t size = entry.Size();
+        if (size > options.max_bytes) {
+            return;
+        }
+        uint64_t key = Key(entry.program, entry.input);
+        auto found = index.find(key);
+        if (found != index.end()) {
+            used_bytes -= found->second->Size();
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        while (!entries.empty() && used_bytes + size > options.max_bytes) {
+            used_bytes -= entries.back().Size();
+            index.erase(Key(entries.back().program, entries.back().input));
+            entries.pop_back();
+        }
+        entries.push_front(std::move(entry));
+        index[key] = entries.begin();
+        used_bytes += size;
+    }
+
+    void Load() {
+        std::ifstream in(options.path, std::ios::binary);
+        if (!in) {
+            throw InvalidArgumentException("Cannot open run cache: " + options.path);
+        }
+        char magic[8];
+        if (!in.read(magic, 8) || std::string(magic, 8) != std::string(MAGIC, 8)) {
+            throw InvalidArgumentException("Not a run cache file: " + options.path);
+        }
+        // Кэш можно выбросить: файл другой версии или испорченный не загружается,
+        // кэш начинается пустым, и Save перезапишет файл
+        try {
+            if (Get(in, 4) != VERSION) {
+                return;
+            }
+            size_t count = static_cast<size_t>(Get(in, 8));
+            for (size_t k = 0; k < count; ++k) {
+                Insert(ReadEntry(in));
+            }
+        }
+        catch (const std::exception&) {
+            Clear();
+        }
+    }
+
+    static void WriteEntry(std::ostream& out, const Entry& entry) {
+        Put(out, entry.program, 8);
+        Put(out, entry.input, 8);
+        PutString(out, entry.start.state);
+        Put(out, entry.start.cycles ? 1 : 0, 1);
+        Put(out, entry.start.tapes.size(), 1);
+        for (const TapeImage& tape : entry.start.tapes) {
+            WriteImage(out, tape);
+        }
+        Put(out, static_cast<uint64_t>(entry.status), 1);
+        Put(out, entry.steps, 8);
+        Put(out, entry.budget, 8);
+        Put(out, entry.cycle_period, 8);
+        PutString(out, entry.final_state);
+        Put(out, entry.tapes.size(), 1);
+        for (const TapeImage& tape : entry.tapes) {
+            WriteImage(out, tape);
+        }
+    }
+
+    static void WriteImage(std::ostream& out, const TapeImage& tape) {
+        Put(out, static_cast<uint64_t>(tape.head), 8);
+        Put(out, static_cast<uint64_t>(tape.first), 8);
+        PutString(out, tape.content);
+    }
+
+    static Entry ReadEntry(std::istream& in) {
+        Entry entry;
+        entry.program = Get(in, 8);
+        entry.input = Get(in, 8);
+        entry.start.state = GetString(in);
+        entry.start.cycles = Get(in, 1) != 0;
+        entry.start.tapes.resize(ReadTapeCount(in));
+        for (TapeImage& tape : entry.start.tapes) {
+            tape = ReadImage(in);
+        }
+        uint64_t status = Get(in, 1);
+        if (status > static_cast<uint64_t>(RunStatus::Cancelled)) {
+            throw std::runtime_error("Run cache is corrupted");
+        }
+        entry.status = static_cast<RunStatus>(status);
+        entry.steps = static_cast<size_t>(Get(in, 8));
+        entry.budget = static_cast<size_t>(Get(in, 8));
+        entry.cycle_period = static_cast<size_t>(Get(in, 8));
+        entry.final_state = GetString(in);
+        entry.tapes.resize(ReadTapeCount(in));
+        for (TapeImage& tape : entry.tapes) {
+            tape = ReadImage(in);
+        }
+        if (entry.tapes.size() != entry.start.tapes.size() || HashStart(entry.start) != entry.input) {
+            throw std::runtime_error("Run cache is corrupted");
+        }
+        return entry;
+    }
+
+    static size_t ReadTapeCount(std::istream& in) {
+        size_t tape_count = static_cast<size_t>(Get(in, 1));
+        if (tape_count == 0 || tape_count > TuringMachine::MAX_TAPES) {
+            throw std::runtime_error("Run cache is corrupted");
+        }
+        return tape_count;
+    }
+
+    static TapeImage ReadImage(std::istream& in) {
+        TapeImage tape;
+        tape.head = static_cast<int64_t>(Get(in, 8));
+        tape.first = static_cast<int64_t>(Get(in, 8));
+        tape.content = GetString(in);
+        return tape;
+    }
+
+    static void Put(std::ostream& out, uint64_t value, size_t bytes) {
+        char buffer[8];
+        for (size_t i = 0; i < bytes; ++i) {
+            buffer[i] = static_cast<char>(value >> (8 * i));
+        }
+        out.write(buffer, static_cast<std::streamsize>(bytes));
+    }
+
+    static uint64_t Get(std::istream& in, size_t bytes) {
+        unsigned char buffer[8] = {};
+        if (!in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(bytes))) {
+            throw std::runtime_error("Run cache is truncated");
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    static void PutString(std::ostream& out, const std::string& value) {
+        Put(out, value.size(), 4);
+        out.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    static std::string GetString(std::istream& in) {
+        std::string value(static_cast<size_t>(Get(in, 4)), '\0');
+        if (!value.empty() && !in.read(&value[0], static_cast<std::streamsize>(value.size()))) {
+            throw std::runtime_error("Run cache is truncated");
+        }
+        return value;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "exceptions.h"
+#include <bitset>
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Множество символов, которые может прочитать переход.
+// Запись в языке машины: x - один символ, [a-z0-9_] - перечисление и диапазоны,
+// * - любой символ, !x - любой символ, кроме x
+class SymbolClass {
+private:
+    std::bitset<256> symbols;
+    std::string text;
+
+public:
+    // Пустой класс: лента не указана
+    SymbolClass() = default;
+
+    static SymbolClass Single(char c) {
+        SymbolClass result;
+        result.symbols.set(static_cast<unsigned char>(c));
+        // Звёздочка как символ записывается в скобках, чтобы не читаться как "любой"
+        result.text = c == '*' ? "[*]" : std::string(1, c);
+        return result;
+    }
+
+    static SymbolClass Any() {
+        SymbolClass result;
+        result.symbols.set();
+        result.text = "*";
+        return result;
+    }
+
+    static SymbolClass Except(char c) {
+        SymbolClass result;
+        result.symbols.set();
+        result.symbols.reset(static_cast<unsigned char>(c));
+        result.text = std::string("!") + c;
+        return result;
+    }
+
+    static SymbolClass Parse(const std::string& source) {
+        if (source.size() == 1) {
+            return source == "*" ? Any() : Single(source[0]);
+        }
+        if (source.size() == 2 && source[0] == '!') {
+            return Except(source[1]);
+        }
+        if (source.size() < 3 || source.front() != '[' || source.back() != ']') {
+            throw InvalidArgumentException("Invalid symbol class: " + source);
+        }
+
+        SymbolClass result;
+        result.text = source;
+        std::string body = source.substr(1, source.size() - 2);
+        for (size_t k = 0; k < body.size(); ++k) {
+            unsigned char first = static_cast<unsigned char>(body[k]);
+            unsigned char last = first;
+            // Дефис в начале или в конце - обычный символ
+            if (k + 2 < body.size() && body[k + 1] == '-') {
+                last = static_cast<unsigned char>(body[k + 2]);
+                k += 2;
+            }
+            if (last < first) {
+                throw InvalidArgumentException("Invalid symbol range in " + source);
+            }
+            for (unsigned c = first; c <= last; ++c) {
+                result.symbols.set(c);
+            }
+        }
+        return result;
+    }
+
+    bool Contains(char c) const {
+        return symbols.test(static_cast<unsigned char>(c));
+    }
+
+    bool IsEmpty() const {
+        return symbols.none();
+    }
+
+    // Ровно один символ - такой переход ничем не отличается от обычного
+    bool IsSingle() const {
+        return symbols.count() == 1;
+    }
+
+    const std::bitset<256>& GetSymbols() const {
+        return symbols;
+    }
+
+    const std::string& GetText() const {
+        return text;
+    }
+
+    bool operator==(const SymbolClass& other) const {
+        return symbols == other.symbols;
+    }
+
+    bool operator!=(const SymbolClass& other) const {
+        return symbols != other.symbols;
+    }
+};
+
+// Разбиение алфавита одной ленты на классы эквивалентности: символы одного класса
+// не различает ни один из учтённых классов переходов. Классов не больше 256
+class SymbolPartition {
+private:
+    std::array<uint16_t, 256> class_of;
+    size_t count;
+
+public:
+    SymbolPartition() : count(1) {
+        class_of.fill(0);
+    }
+
+    // Разделить классы так, чтобы каждый лежал целиком внутри symbols или вне его
+    void Refine(const SymbolClass& symbols) {
+        std::vector<int> renumber(2 * count, -1);
+        uint16_t next = 0;
+        for (unsigned c = 0; c < 256; ++c) {
+            int& id = renumber[2 * class_of[c] + (symbols.GetSymbols().test(c) ? 1 : 0)];
+            if (id < 0) {
+                id = next++;
+            }
+            class_of[c] = static_cast<uint16_t>(id);
+        }
+        count = next;
+    }
+
+    size_t GetCount() const {
+        return count;
+    }
+
+    const std::array<uint16_t, 256>& GetTable() const {
+        return class_of;
+    }
+
+    // Классы, из которых состоит symbols (после Refine по нему)
+    std::vector<uint16_t> ClassesIn(const SymbolClass& symbols) const {
+        std::vector<bool> seen(count, false);
+        std::vector<uint16_t> result;
+        for (unsigned c = 0; c < 256; ++c) {
+            if (symbols.GetSymbols().test(c) && !seen[class_of[c]]) {
+                seen[class_of[c]] = true;
+                result.push_back(class_of[c]);
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "exceptions.h"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Вход ленты: неизменяемые байты, общие для всех копий ленты.
+// Непрочитанные ячейки входа читаются прямо отсюда, в страницы ленты попадают только тронутые.
+// Байты могут становиться известны постепенно (потоковый вход), но уже известные не меняются
+// и Data() остаётся прежним
+class TapeInput {
+public:
+    virtual ~TapeInput() = default;
+
+    const char* Data() const {
+        return data;
+    }
+
+    // Дождаться, пока станут известны байты [0, end) или вход закончится.
+    // Возвращает число известных байтов; complete - других байтов не будет
+    virtual size_t Require(size_t end, bool& complete) {
+        (void)end;
+        complete = true;
+        return size;
+    }
+
+    // Собственная копия строки
+    static std::shared_ptr<TapeInput> FromString(const std::string& text);
+
+    // Чужая память без копирования; она должна жить, пока живут ленты (и их копии) с этим входом
+    static std::shared_ptr<TapeInput> FromView(std::string_view view);
+
+    // Файл, отображённый в память только для чтения: страницы подгружаются системой по мере чтения.
+    // Канал или устройство по этому пути читается потоком
+    static std::shared_ptr<TapeInput> FromFile(const std::string& path);
+
+    // Поток из дескриптора (канал, stdin): читается в фоне не дальше read_ahead байтов
+    // за последним запрошенным. Дескриптор дублируется, исходный можно закрыть
+    static std::shared_ptr<TapeInput> FromStream(int fd, size_t read_ahead = 1 << 20);
+
+protected:
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// Вход со своей строкой; единственный владелец может заменить её без нового выделения
+class StringTapeInput final : public TapeInput {
+private:
+    std::string text;
+
+public:
+    explicit StringTapeInput(std::string value) : text(std::move(value)) {
+        data = text.data();
+        size = text.size();
+    }
+
+    void Assign(const std::string& value) {
+        text = value;
+        data = text.data();
+        size = text.size();
+    }
+};
+
+// Вход поверх чужой памяти
+class ViewTapeInput final : public TapeInput {
+public:
+    explicit ViewTapeInput(std::string_view view) {
+        data = view.data();
+        size = view.size();
+    }
+};
+
+#ifndef _WIN32
+// Отображение файла в память; снимается вместе с последней лентой, которая его читает.
+// Отображение держит файл само, дескриптор после конструктора не нужен
+class MappedTapeInput final : public TapeInput {
+public:
+    MappedTapeInput(int fd, size_t length, const std::string& path) {
+        size = length;
+        if (size > 0) {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                throw InvalidArgumentException("Cannot map input file: " + path);
+            }
+            data = static_cast<const char*>(mapping);
+        }
+    }
+
+    ~MappedTapeInput() override {
+        if (size > 0) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    MappedTapeInput(const MappedTapeInput&) = delete;
+    MappedTapeInput& operator=(const MappedTapeInput&) = delete;
+};
+
+// Потоковый вход. Фоновый поток читает дескриптор кусками по CHUNK_SIZE, пока не опередит
+// наибольшую запрошенную границу на read_ahead байтов, и ждёт новых запросов.
+// Прочитанное копится в заранее зарезервированной области адресов: память выделяется по мере
+// чтения, а Data() не меняется, поэтому ленты читают известные байты без блокировки
+class StreamTapeInput final : public TapeInput {
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    char* buffer = nullptr;
+    size_t capacity = 0;  // размер зарезервированной области
+    size_t committed = 0;  // байты области, открытые для записи (только фоновый поток)
+    size_t read_ahead = 0;
+    int fd = -1;
+    int wake[2] = { -1, -1 };  // канал, будящий фоновый поток при закрытии
+
+    // Под mutex: size, wanted, finished, stopping, error
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t wanted = 0;  // наибольшая запрошенная граница
+    bool finished = false;
+    bool stopping = false;
+    std::string error;
+    std::thread reader;
+
+    // Ждать данных в дескрипторе или сигнала закрытия; false - закрытие
+    bool WaitReadable() {
+        pollfd fds[2] = { { fd, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+        while (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR) {
+                return true;  // ошибку покажет read
+            }
+        }
+        return !(fds[1].revents & POLLIN);
+    }
+
+    void Read() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this] { return stopping || size < wanted + read_ahead; });
+            if (stopping) {
+                return;
+            }
+            size_t at = size;
+            lock.unlock();
+
+            ssize_t count = 0;
+            std::string failure;
+            if (at == capacity) {
+                failure = "Input stream is longer than " + std::to_string(capacity) + " bytes";
+            }
+            else if (committed == at && mprotect(buffer + committed, CHUNK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+                failure = "Cannot allocate memory for input stream";
+            }
+            else {
+                if (committed == at) {
+                    committed += CHUNK_SIZE;
+                }
+                if (!WaitReadable()) {
+                    return;
+                }
+                do {
+                    count = read(fd, buffer + at, committed - at);
+                } while (count < 0 && errno == EINTR);
+                if (count < 0) {
+                    failure = "Cannot read input stream";
+                }
+            }
+
+            lock.lock();
+            if (count > 0) {
+                size += static_cast<size_t>(count);
+            }
+            else {
+                finished = true;
+                error = failure;
+            }
+            changed.notify_all();
+            if (finished) {
+                return;
+            }
+        }
+    }
+
+public:
+    // limit - предел длины входа, под него резервируются адреса (не память):
+    // по умолчанию 1 ТБ, на 32-битных системах 1 ГБ
+    StreamTapeInput(int source, size_t ahead = 1 << 20,
+        size_t limit = size_t(1) << (sizeof(void*) >= 8 ? 40 : 30))
+        : capacity((limit + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE), read_ahead(ahead) {
+        fd = dup(source);
+        if (fd < 0) {
+            throw InvalidArgumentException("Cannot use input descriptor " + std::to_string(source));
+        }
+        if (pipe(wake) != 0) {
+            close(fd);
+            throw InvalidStateException("Cannot create input stream");
+        }
+        // Резерв адресов без памяти: страницы открываются для записи по мере чтения
+        void* region = mmap(nullptr, capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED) {
+            close(fd);
+            close(wake[0]);
+            close(wake[1]);
+            throw InvalidStateException("Cannot reserve memory for input stream");
+        }
+        buffer = static_cast<char*>(region);
+        data = buffer;
+        reader = std::thread([this] { Read(); });
+    }
+
+    ~StreamTapeInput() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        char byte = 0;
+        if (write(wake[1], &byte, 1) < 0) {
+            // Поток всё равно проснётся по stopping, если не ждёт дескриптор
+        }
+        reader.join();
+        close(fd);
+        close(wake[0]);
+        close(wake[1]);
+        munmap(buffer, capacity);
+    }
+
+    StreamTapeInput(const StreamTapeInput&) = delete;
+    StreamTapeInput& operator=(const StreamTapeInput&) = delete;
+
+    size_t Require(size_t end, bool& complete) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (end > wanted) {
+            wanted = end;
+            changed.notify_all();
+        }
+        changed.wait(lock, [&] { return size >= end || finished; });
+        if (size < end && !error.empty()) {
+            throw std::runtime_error(error);
+        }
+        complete = finished && error.empty();
+        return size;
+    }
+};
+#endif
+
+inline std::shared_ptr<TapeInput> TapeInput::FromString(const std::string& text) {
+    return std::make_shared<StringTapeInput>(text);
+}
+
+inline std::shared_ptr<TapeInput> TapeInput::FromView(std::string_view view) {
+    return std::make_shared<ViewTapeInput>(view);
+}
+
+inline std::shared_ptr<TapeInput> TapeInput::FromFile(const std::string& path) {
+#ifdef _WIN32
+    // Без mmap файл читается целиком
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw InvalidArgumentException("Cannot open input file: " + path);
+    }
+    std::ostringstream content;
+    content << in.rdbuf();
+    return std::make_shared<StringTapeInput>(content.str());
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw InvalidArgumentException("Cannot open input file: " + path);
+    }
+    std::shared_ptr<TapeInput> input;
+    try {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            throw InvalidArgumentException("Cannot read input file: " + path);
+        }
+        if (S_ISREG(info.st_mode)) {
+            input = std::make_shared<MappedTapeInput>(fd, static_cast<size_t>(info.st_size), path);
+        }
+        else {
+            input = std::make_shared<StreamTapeInput>(fd);
+        }
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return input;
+#endif
+}
+
+inline std::shared_ptr<TapeInput> TapeInput::FromStream(int fd, size_t read_ahead) {
+#ifdef _WIN32
+    // Без фонового чтения поток читается целиком
+    std::string content;
+    char chunk[1 << 16];
+    int count;
+    while ((count = _read(fd, chunk, sizeof(chunk))) > 0) {
+        content.append(chunk, static_cast<size_t>(count));
+    }
+    if (count < 0) {
+        throw InvalidArgumentException("Cannot read input stream");
+    }
+    return std::make_shared<StringTapeInput>(content);
+#else
+    return std::make_shared<StreamTapeInput>(fd, read_ahead);
+#endif
+}
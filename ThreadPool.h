@@ -0,0 +1,152 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+// Пул потоков с захватом работы (work stealing).
+// У каждого потока своя очередь: свои задачи берутся с конца, чужие - с начала
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued;   // задачи в очередях
+    std::atomic<size_t> pending;  // задачи, ещё не завершённые
+    std::atomic<size_t> next_queue;
+    std::atomic<bool> stopping;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    // Поток пула помнит свой пул: задача одного пула может ставить задачи в другой
+    struct WorkerSlot {
+        const WorkStealingPool* owner = nullptr;
+        int index = -1;
+    };
+
+    static WorkerSlot& CurrentWorker() {
+        static thread_local WorkerSlot slot;
+        return slot;
+    }
+
+public:
+    explicit WorkStealingPool(size_t thread_count = 0)
+        : queued(0), pending(0), next_queue(0), stopping(false) {
+        if (thread_count == 0) {
+            thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (size_t i = 0; i < thread_count; ++i) {
+            workers.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    size_t GetThreadCount() const {
+        return workers.size();
+    }
+
+    // Номер текущего потока в этом пуле или -1 для остальных потоков
+    int GetWorkerIndex() const {
+        const WorkerSlot& slot = CurrentWorker();
+        return slot.owner == this ? slot.index : -1;
+    }
+
+    // Задача из потока пула попадает в его собственную очередь, внешняя - распределяется по кругу
+    void Submit(Task task) {
+        int self = GetWorkerIndex();
+        size_t target = self >= 0 ? static_cast<size_t>(self) : next_queue++ % queues.size();
+
+        // Счётчик растёт до публикации задачи: вор может забрать её и уменьшить queued сразу
+        pending++;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            queued++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Дождаться завершения всех поставленных задач
+    void Wait() {
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    bool TryPop(size_t self, Task& task) {
+        {
+            WorkerQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues.size(); ++k) {
+            WorkerQueue& victim = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t self) {
+        CurrentWorker() = WorkerSlot{ this, static_cast<int>(self) };
+        while (true) {
+            Task task;
+            if (TryPop(self, task)) {
+                queued--;
+                task();
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                    idle.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,897 @@
+#pragma once
+
+#include "multi_tape_turing_machine.h"
+#include "exceptions.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+// Формат файла трассы (все числа little-endian):
+//   заголовок: "MTMTRACE", версия, число лент, пустой символ, номер первого шага, шагов в блоке,
+//              имена состояний, таблица переходов (откуда, куда; по лентам - класс чтения,
+//              запись, лента копирования, сдвиг)
+//   записи:    'B' блок номеров переходов | 'S' снимок лент
+//   индекс:    всего шагов; по блоку - смещение, состояние и головки перед блоком;
+//              по снимку - шаг и смещение; в конце смещение индекса и "MTMINDEX"
+// Блок содержит серии одинаковых переходов: номер фиксированной ширины и длина серии
+// в гамма-коде Элиаса, так что одиночный шаг занимает ширину номера плюс один бит
+struct TraceOptions {
+    size_t block_steps = 65536;                // шагов в блоке, с этим шагом идёт индекс
+    size_t snapshot_steps = size_t(1) << 24;   // шагов между снимками лент, 0 - только начальный
+    size_t queue_limit = 64;                   // порций номеров в очереди к фоновому потоку
+};
+
+// Одна ячейка трассы: что сделал шаг step (из конфигурации step в step + 1)
+struct TraceStep {
+    size_t step = 0;
+    uint32_t transition = 0;
+    std::string state_from;
+    std::string state_to;
+    std::string read;
+    std::string write;
+    std::string moves;              // L, S, R по лентам
+    std::vector<int64_t> heads;     // головки до шага
+};
+
+// Конфигурация машины после заданного числа шагов
+struct TraceConfiguration {
+    size_t step = 0;
+    std::string state;
+    std::vector<int64_t> heads;
+    std::vector<int64_t> tape_start;   // индекс первой ячейки в tapes
+    std::vector<std::string> tapes;
+    char blank = ' ';
+
+    std::string GetTapeContent(size_t tape, int64_t from, int64_t to) const {
+        std::string result;
+        for (int64_t i = from; i <= to; ++i) {
+            int64_t offset = i - tape_start[tape];
+            bool inside = offset >= 0 && offset < static_cast<int64_t>(tapes[tape].size());
+            result += inside ? tapes[tape][static_cast<size_t>(offset)] : blank;
+        }
+        return result;
+    }
+};
+
+// Двоичная запись и чтение полей трассы
+struct TraceIo {
+    static constexpr char MAGIC[9] = "MTMTRACE";
+    static constexpr char INDEX_MAGIC[9] = "MTMINDEX";
+    static constexpr uint32_t VERSION = 1;
+    static constexpr char BLOCK_RECORD = 'B';
+    static constexpr char SNAPSHOT_RECORD = 'S';
+
+    static void Put(std::ostream& out, uint64_t value, size_t bytes) {
+        char buffer[8];
+        for (size_t i = 0; i < bytes; ++i) {
+            buffer[i] = static_cast<char>(value >> (8 * i));
+        }
+        out.write(buffer, static_cast<std::streamsize>(bytes));
+    }
+
+    static uint64_t Get(std::istream& in, size_t bytes) {
+        unsigned char buffer[8] = {};
+        if (!in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(bytes))) {
+            throw std::runtime_error("Trace file is truncated");
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    static void PutString(std::ostream& out, const std::string& value) {
+        Put(out, value.size(), 4);
+        out.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
+
+    static std::string GetString(std::istream& in) {
+        std::string value(static_cast<size_t>(Get(in, 4)), '\0');
+        if (!in.read(&value[0], static_cast<std::streamsize>(value.size()))) {
+            throw std::runtime_error("Trace file is truncated");
+        }
+        return value;
+    }
+
+    // Бит на номер перехода
+    static size_t IdBits(size_t transition_count) {
+        size_t bits = 1;
+        while (bits < 32 && (uint64_t(1) << bits) < transition_count) {
+            bits++;
+        }
+        return bits;
+    }
+};
+
+// Побитовая запись блока
+class TraceBitWriter {
+private:
+    std::vector<uint8_t> bytes;
+    uint64_t accumulator = 0;
+    size_t filled = 0;
+
+public:
+    void Put(uint64_t value, size_t bits) {
+        if (bits == 0) {
+            return;
+        }
+        if (bits < 64) {
+            value &= (uint64_t(1) << bits) - 1;
+        }
+        accumulator |= value << filled;
+        size_t total = filled + bits;
+        if (total < 64) {
+            filled = total;
+            return;
+        }
+        size_t consumed = 64 - filled;
+        Drain(8);
+        accumulator = consumed < 64 ? value >> consumed : 0;
+        filled = total - 64;
+    }
+
+    // Гамма-код Элиаса для value >= 1: число значащих бит минус один нулей, затем само число
+    void PutGamma(uint64_t value) {
+        size_t width = 0;
+        while ((value >> width) > 1) {
+            width++;
+        }
+        Put(0, width);
+        for (size_t i = width + 1; i-- > 0;) {
+            Put((value >> i) & 1, 1);
+        }
+    }
+
+    // Дописать неполный байт и забрать результат
+    std::vector<uint8_t> Take() {
+        Drain((filled + 7) / 8);
+        std::vector<uint8_t> result;
+        result.swap(bytes);
+        return result;
+    }
+
+private:
+    void Drain(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            bytes.push_back(static_cast<uint8_t>(accumulator >> (8 * i)));
+        }
+        accumulator = 0;
+        filled = 0;
+    }
+};
+
+// Побитовое чтение блока
+class TraceBitReader {
+private:
+    const std::vector<uint8_t>& bytes;
+    size_t position = 0;
+
+public:
+    explicit TraceBitReader(const std::vector<uint8_t>& data) : bytes(data) {}
+
+    uint64_t Get(size_t bits) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bits; ++i) {
+            value |= static_cast<uint64_t>(Bit()) << i;
+        }
+        return value;
+    }
+
+    uint64_t GetGamma() {
+        size_t width = 0;
+        while (Bit() == 0) {
+            width++;
+        }
+        uint64_t value = 1;
+        for (size_t i = 0; i < width; ++i) {
+            value = (value << 1) | Bit();
+        }
+        return value;
+    }
+
+private:
+    unsigned Bit() {
+        if (position >= bytes.size() * 8) {
+            throw std::runtime_error("Trace block is corrupted");
+        }
+        unsigned bit = (bytes[position / 8] >> (position % 8)) & 1;
+        position++;
+        return bit;
+    }
+};
+
+// Лента при воспроизведении трассы: непрерывный буфер, растущий в обе стороны
+class TraceTape {
+private:
+    std::vector<char> cells;
+    int64_t start = 0;
+    char blank = ' ';
+
+public:
+    TraceTape() = default;
+
+    TraceTape(char blank_symbol, int64_t first, const std::string& content)
+        : cells(content.begin(), content.end()), start(first), blank(blank_symbol) {
+    }
+
+    void Set(int64_t index, char value) {
+        if (index < start || index >= start + static_cast<int64_t>(cells.size())) {
+            if (value == blank) {
+                return;
+            }
+            Grow(index);
+        }
+        cells[static_cast<size_t>(index - start)] = value;
+    }
+
+    int64_t GetStart() const {
+        return start;
+    }
+
+    char Get(int64_t index) const {
+        bool inside = index >= start && index < start + static_cast<int64_t>(cells.size());
+        return inside ? cells[static_cast<size_t>(index - start)] : blank;
+    }
+
+    std::string GetContent() const {
+        return std::string(cells.begin(), cells.end());
+    }
+
+private:
+    void Grow(int64_t index) {
+        if (cells.empty()) {
+            start = index;
+            cells.assign(1, blank);
+            return;
+        }
+        int64_t end = start + static_cast<int64_t>(cells.size());
+        int64_t spare = std::max<int64_t>(64, static_cast<int64_t>(cells.size()));
+        if (index < start) {
+            int64_t added = start - index + spare;
+            cells.insert(cells.begin(), static_cast<size_t>(added), blank);
+            start -= added;
+        }
+        else {
+            cells.resize(static_cast<size_t>(index - end + spare + static_cast<int64_t>(cells.size())), blank);
+        }
+    }
+};
+
+// Действие шага при воспроизведении: как у машины, копируемые символы читаются до записи
+struct TraceAction {
+    uint32_t state_to = 0;
+    std::vector<char> write;
+    std::vector<int> copy_from;
+    std::vector<int> moves;
+
+    void Apply(std::vector<TraceTape>& tapes, std::vector<int64_t>& heads) const {
+        char written[TuringMachine::MAX_TAPES];
+        for (size_t i = 0; i < tapes.size(); ++i) {
+            written[i] = copy_from[i] < 0 ? write[i] : tapes[copy_from[i]].Get(heads[copy_from[i]]);
+        }
+        for (size_t i = 0; i < tapes.size(); ++i) {
+            tapes[i].Set(heads[i], written[i]);
+            heads[i] += moves[i];
+        }
+    }
+};
+
+// Запись полной трассы выполнения. Подключается к машине как приёмник шагов, номера
+// переходов кодируются и пишутся на диск фоновым потоком. Записываются шаги, сделанные
+// машиной от создания записи до Close; машина должна пережить запись
+class TraceRecorder : public StepSink {
+private:
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t state;
+        std::vector<int64_t> heads;
+    };
+
+    struct SnapshotEntry {
+        uint64_t step;
+        uint64_t offset;
+    };
+
+    TuringMachine& machine;
+    TraceOptions options;
+    std::ofstream out;
+    size_t tape_count;
+    size_t id_bits;
+    std::vector<TraceAction> steps;
+
+    // Очередь от машины к фоновому потоку и запас пустых буферов
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint32_t>> queue;
+    std::vector<std::vector<uint32_t>> spare;
+    bool finishing;
+    bool closed;
+    std::exception_ptr failure;
+    std::thread worker;
+    size_t handed_steps;
+
+    // Состояние фонового потока
+    uint32_t state;
+    std::vector<int64_t> heads;
+    std::vector<TraceTape> tapes;
+    uint64_t recorded;
+    TraceBitWriter block;
+    size_t block_filled;
+    uint32_t run_id;
+    uint64_t run_length;
+    size_t until_snapshot;
+    std::vector<BlockEntry> blocks;
+    std::vector<SnapshotEntry> snapshots;
+
+public:
+    TraceRecorder(const std::string& path, TuringMachine& target, const TraceOptions& opts = TraceOptions())
+        : machine(target),
+        options(opts),
+        out(path, std::ios::binary),
+        tape_count(target.GetActiveTapeCount()),
+        id_bits(1),
+        finishing(false),
+        closed(false),
+        handed_steps(0),
+        state(0),
+        recorded(0),
+        block_filled(0),
+        run_id(0),
+        run_length(0),
+        until_snapshot(opts.snapshot_steps) {
+        if (!out) {
+            throw InvalidArgumentException("Cannot open trace file: " + path);
+        }
+        if (options.block_steps == 0) {
+            throw InvalidArgumentException("Trace block must contain at least one step");
+        }
+        // Шаги вложенных машин нумеруются по их программам и не воспроизводятся по трассе
+        if (machine.HasSubMachines()) {
+            throw InvalidArgumentException("Trace recording does not support sub-machine calls");
+        }
+        // Начальный снимок берёт ленты целиком, недочитанный поток в него не попал бы
+        for (size_t i = 0; i < tape_count; ++i) {
+            if (!machine.GetTape(i)->IsInputComplete()) {
+                throw InvalidArgumentException("Trace recording does not support unread stream input");
+            }
+        }
+        WriteHeader();
+        WriteSnapshot();
+        worker = std::thread([this]() { Work(); });
+        machine.SetStepSink(this);
+    }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    ~TraceRecorder() {
+        try {
+            Close();
+        }
+        catch (...) {
+        }
+    }
+
+    // Вызывается машиной; ждёт, если фоновый поток отстал на queue_limit порций
+    void Consume(std::vector<uint32_t>& batch) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return queue.size() < options.queue_limit || failure; });
+        if (failure) {
+            // Ошибка будет выдана в Close
+            batch.clear();
+            return;
+        }
+        handed_steps += batch.size();
+        queue.emplace_back();
+        queue.back().swap(batch);
+        if (!spare.empty()) {
+            batch.swap(spare.back());
+            spare.pop_back();
+        }
+        changed.notify_all();
+    }
+
+    // Отключиться от машины, дописать очередь и индекс
+    void Close() {
+        if (closed) {
+            return;
+        }
+        closed = true;
+        machine.SetStepSink(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+        }
+        changed.notify_all();
+        worker.join();
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        FlushBlock();
+        WriteIndex();
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Failed to write trace file");
+        }
+    }
+
+    // Шагов, переданных машиной на запись
+    size_t GetRecordedSteps() const {
+        return handed_steps;
+    }
+
+private:
+    void WriteHeader() {
+        Sequence<TuringMachine::PatternTransition> compiled = machine.GetCompiledTransitions();
+        std::unordered_map<std::string, uint32_t> ids;
+        std::vector<std::string> names;
+        auto intern = [&](const std::string& name) {
+            auto inserted = ids.emplace(name, static_cast<uint32_t>(names.size()));
+            if (inserted.second) {
+                names.push_back(name);
+            }
+            return inserted.first->second;
+        };
+
+        state = intern(machine.GetCurrentState());
+        std::vector<uint32_t> from(compiled.GetSize());
+        steps.resize(compiled.GetSize());
+        for (size_t k = 0; k < compiled.GetSize(); ++k) {
+            const TuringMachine::PatternTransition& t = compiled[k];
+            from[k] = intern(t.state_from);
+            steps[k].state_to = intern(t.state_to);
+            steps[k].write.assign(t.write_symbols.begin(), t.write_symbols.begin() + tape_count);
+            steps[k].copy_from.assign(t.copy_from.begin(), t.copy_from.begin() + tape_count);
+            steps[k].moves.assign(t.moves.begin(), t.moves.begin() + tape_count);
+        }
+        id_bits = TraceIo::IdBits(compiled.GetSize());
+
+        out.write(TraceIo::MAGIC, 8);
+        TraceIo::Put(out, TraceIo::VERSION, 4);
+        TraceIo::Put(out, tape_count, 4);
+        TraceIo::Put(out, static_cast<unsigned char>(machine.GetBlankSymbol()), 1);
+        TraceIo::Put(out, machine.GetStepCount(), 8);
+        TraceIo::Put(out, options.block_steps, 8);
+        TraceIo::Put(out, names.size(), 4);
+        for (const std::string& name : names) {
+            TraceIo::PutString(out, name);
+        }
+        TraceIo::Put(out, compiled.GetSize(), 4);
+        for (size_t k = 0; k < compiled.GetSize(); ++k) {
+            const TuringMachine::PatternTransition& t = compiled[k];
+            TraceIo::Put(out, from[k], 4);
+            TraceIo::Put(out, steps[k].state_to, 4);
+            for (size_t i = 0; i < tape_count; ++i) {
+                TraceIo::PutString(out, t.read_classes[i].GetText());
+                TraceIo::Put(out, static_cast<unsigned char>(t.write_symbols[i]), 1);
+                TraceIo::Put(out, static_cast<uint8_t>(static_cast<int8_t>(t.copy_from[i])), 1);
+                TraceIo::Put(out, static_cast<uint8_t>(static_cast<int8_t>(t.moves[i])), 1);
+            }
+        }
+
+        std::array<int64_t, TuringMachine::MAX_TAPES> positions = machine.GetHeadPositions();
+        for (size_t i = 0; i < tape_count; ++i) {
+            const BidirectionalLazyTape<char>* tape = machine.GetTape(i);
+            int64_t lo = std::min(tape->GetMinIndex(), positions[i]);
+            int64_t hi = std::max(tape->GetMaxIndex(), positions[i]);
+            heads.push_back(positions[i]);
+            tapes.emplace_back(machine.GetBlankSymbol(), lo, tape->GetContent(lo, hi));
+        }
+    }
+
+    void Work() {
+        try {
+            while (true) {
+                std::vector<uint32_t> batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [this]() { return !queue.empty() || finishing; });
+                    if (queue.empty()) {
+                        return;
+                    }
+                    batch.swap(queue.front());
+                    queue.pop_front();
+                    changed.notify_all();
+                }
+
+                for (uint32_t id : batch) {
+                    Record(id);
+                }
+
+                batch.clear();
+                std::lock_guard<std::mutex> lock(mutex);
+                spare.push_back(std::move(batch));
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failure = std::current_exception();
+            changed.notify_all();
+        }
+    }
+
+    void Record(uint32_t id) {
+        if (block_filled == 0) {
+            blocks.push_back(BlockEntry{ 0, state, heads });
+        }
+        if (run_length > 0 && id == run_id) {
+            run_length++;
+        }
+        else {
+            FlushRun();
+            run_id = id;
+            run_length = 1;
+        }
+
+        steps[id].Apply(tapes, heads);
+        state = steps[id].state_to;
+        recorded++;
+
+        if (++block_filled == options.block_steps) {
+            FlushBlock();
+        }
+        if (options.snapshot_steps > 0 && --until_snapshot == 0) {
+            WriteSnapshot();
+            until_snapshot = options.snapshot_steps;
+        }
+    }
+
+    void FlushRun() {
+        if (run_length > 0) {
+            block.Put(run_id, id_bits);
+            block.PutGamma(run_length);
+            run_length = 0;
+        }
+    }
+
+    void FlushBlock() {
+        if (block_filled == 0) {
+            return;
+        }
+        FlushRun();
+        std::vector<uint8_t> bytes = block.Take();
+        blocks.back().offset = static_cast<uint64_t>(out.tellp());
+        out.put(TraceIo::BLOCK_RECORD);
+        TraceIo::Put(out, bytes.size(), 8);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        block_filled = 0;
+    }
+
+    void WriteSnapshot() {
+        snapshots.push_back(SnapshotEntry{ recorded, static_cast<uint64_t>(out.tellp()) });
+        out.put(TraceIo::SNAPSHOT_RECORD);
+        TraceIo::Put(out, recorded, 8);
+        TraceIo::Put(out, state, 4);
+        for (size_t i = 0; i < tape_count; ++i) {
+            std::string content = tapes[i].GetContent();
+            TraceIo::Put(out, static_cast<uint64_t>(heads[i]), 8);
+            TraceIo::Put(out, static_cast<uint64_t>(tapes[i].GetStart()), 8);
+            TraceIo::Put(out, content.size(), 8);
+            out.write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+    }
+
+    void WriteIndex() {
+        uint64_t index_offset = static_cast<uint64_t>(out.tellp());
+        TraceIo::Put(out, recorded, 8);
+        TraceIo::Put(out, blocks.size(), 8);
+        for (const BlockEntry& entry : blocks) {
+            TraceIo::Put(out, entry.offset, 8);
+            TraceIo::Put(out, entry.state, 4);
+            for (int64_t head : entry.heads) {
+                TraceIo::Put(out, static_cast<uint64_t>(head), 8);
+            }
+        }
+        TraceIo::Put(out, snapshots.size(), 8);
+        for (const SnapshotEntry& entry : snapshots) {
+            TraceIo::Put(out, entry.step, 8);
+            TraceIo::Put(out, entry.offset, 8);
+        }
+        TraceIo::Put(out, index_offset, 8);
+        out.write(TraceIo::INDEX_MAGIC, 8);
+    }
+};
+
+// Чтение трассы с произвольным доступом: шаг находится через индекс блоков,
+// конфигурация восстанавливается от ближайшего снимка без выполнения машины
+class TraceReader {
+private:
+    struct BlockEntry {
+        uint64_t offset;
+        uint32_t state;
+        std::vector<int64_t> heads;
+    };
+
+    struct SnapshotEntry {
+        uint64_t step;
+        uint64_t offset;
+    };
+
+    mutable std::ifstream in;
+    size_t tape_count;
+    char blank;
+    size_t first_step;
+    size_t block_steps;
+    size_t total_steps;
+    size_t id_bits;
+    std::vector<std::string> state_names;
+    std::vector<uint32_t> from;
+    std::vector<TraceAction> actions;
+    std::vector<std::string> reads;
+    std::vector<std::string> writes;
+    std::vector<BlockEntry> blocks;
+    std::vector<SnapshotEntry> snapshots;
+
+    // Последний разобранный блок
+    mutable size_t cached_block;
+    mutable std::vector<uint32_t> cached_ids;
+
+public:
+    explicit TraceReader(const std::string& path)
+        : in(path, std::ios::binary),
+        cached_block(SIZE_MAX) {
+        if (!in) {
+            throw InvalidArgumentException("Cannot open trace file: " + path);
+        }
+        ReadHeader();
+        ReadIndex();
+    }
+
+    size_t GetTapeCount() const {
+        return tape_count;
+    }
+
+    size_t GetTransitionCount() const {
+        return actions.size();
+    }
+
+    // Номер шага машины, с которого началась запись
+    size_t GetFirstStep() const {
+        return first_step;
+    }
+
+    size_t GetStepCount() const {
+        return total_steps;
+    }
+
+    // Номер шага машины после последнего записанного шага
+    size_t GetLastStep() const {
+        return first_step + total_steps;
+    }
+
+    // Шаг step (номер шага машины), first_step <= step < GetLastStep()
+    TraceStep GetStep(size_t step) const {
+        CheckStep(step, GetLastStep() - 1);
+        size_t relative = step - first_step;
+        size_t block_index = relative / block_steps;
+        const std::vector<uint32_t>& ids = LoadBlock(block_index);
+
+        TraceStep result;
+        result.step = step;
+        result.heads = blocks[block_index].heads;
+        size_t offset = relative % block_steps;
+        for (size_t k = 0; k < offset; ++k) {
+            for (size_t i = 0; i < tape_count; ++i) {
+                result.heads[i] += actions[ids[k]].moves[i];
+            }
+        }
+        Describe(ids[offset], result);
+        return result;
+    }
+
+    // Конфигурация после step - first_step записанных шагов, first_step <= step <= GetLastStep()
+    TraceConfiguration GetConfiguration(size_t step) const {
+        CheckStep(step, GetLastStep());
+        uint64_t relative = step - first_step;
+        auto snapshot = std::upper_bound(snapshots.begin(), snapshots.end(), relative,
+            [](uint64_t value, const SnapshotEntry& entry) { return value < entry.step; });
+        --snapshot;
+
+        uint32_t state = 0;
+        std::vector<int64_t> heads;
+        std::vector<TraceTape> tapes;
+        ReadSnapshot(*snapshot, state, heads, tapes);
+
+        for (size_t position = static_cast<size_t>(snapshot->step); position < relative;) {
+            size_t block_index = position / block_steps;
+            const std::vector<uint32_t>& ids = LoadBlock(block_index);
+            size_t end = std::min(ids.size(), static_cast<size_t>(relative) - block_index * block_steps);
+            for (size_t k = position % block_steps; k < end; ++k, ++position) {
+                actions[ids[k]].Apply(tapes, heads);
+                state = actions[ids[k]].state_to;
+            }
+        }
+
+        TraceConfiguration result;
+        result.step = step;
+        result.state = state_names[state];
+        result.heads = heads;
+        result.blank = blank;
+        for (const TraceTape& tape : tapes) {
+            result.tape_start.push_back(tape.GetStart());
+            result.tapes.push_back(tape.GetContent());
+        }
+        return result;
+    }
+
+    // Пройти шаги [from, to) по порядку, visit(const TraceStep&)
+    template <typename Visitor>
+    void ForEachStep(size_t from_step, size_t to_step, Visitor visit) const {
+        if (from_step >= to_step) {
+            return;
+        }
+        CheckStep(to_step - 1, GetLastStep() - 1);
+        TraceStep current = GetStep(from_step);
+        visit(current);
+        for (size_t step = from_step + 1; step < to_step; ++step) {
+            size_t relative = step - first_step;
+            const std::vector<uint32_t>& ids = LoadBlock(relative / block_steps);
+            for (size_t i = 0; i < tape_count; ++i) {
+                current.heads[i] += actions[current.transition].moves[i];
+            }
+            current.step = step;
+            Describe(ids[relative % block_steps], current);
+            visit(current);
+        }
+    }
+
+private:
+    void CheckStep(size_t step, size_t last) const {
+        if (step < first_step || step > last) {
+            throw std::out_of_range("Step " + std::to_string(step) + " is outside of the trace");
+        }
+    }
+
+    void Describe(uint32_t id, TraceStep& result) const {
+        result.transition = id;
+        result.state_from = state_names[from[id]];
+        result.state_to = state_names[actions[id].state_to];
+        result.read = reads[id];
+        result.write = writes[id];
+        result.moves.clear();
+        for (int move : actions[id].moves) {
+            result.moves += move < 0 ? 'L' : move > 0 ? 'R' : 'S';
+        }
+    }
+
+    void ReadHeader() {
+        char magic[8];
+        if (!in.read(magic, 8) || std::string(magic, 8) != std::string(TraceIo::MAGIC, 8)) {
+            throw std::runtime_error("Not a trace file");
+        }
+        if (TraceIo::Get(in, 4) != TraceIo::VERSION) {
+            throw std::runtime_error("Unsupported trace version");
+        }
+        tape_count = static_cast<size_t>(TraceIo::Get(in, 4));
+        blank = static_cast<char>(TraceIo::Get(in, 1));
+        first_step = static_cast<size_t>(TraceIo::Get(in, 8));
+        block_steps = static_cast<size_t>(TraceIo::Get(in, 8));
+        if (tape_count == 0 || tape_count > TuringMachine::MAX_TAPES || block_steps == 0) {
+            throw std::runtime_error("Trace header is corrupted");
+        }
+
+        size_t state_count = static_cast<size_t>(TraceIo::Get(in, 4));
+        for (size_t k = 0; k < state_count; ++k) {
+            state_names.push_back(TraceIo::GetString(in));
+        }
+        size_t transition_count = static_cast<size_t>(TraceIo::Get(in, 4));
+        id_bits = TraceIo::IdBits(transition_count);
+        for (size_t k = 0; k < transition_count; ++k) {
+            TuringMachine::PatternTransition rule;
+            TraceAction action;
+            from.push_back(static_cast<uint32_t>(TraceIo::Get(in, 4)));
+            action.state_to = static_cast<uint32_t>(TraceIo::Get(in, 4));
+            if (from.back() >= state_count || action.state_to >= state_count) {
+                throw std::runtime_error("Trace header is corrupted");
+            }
+            for (size_t i = 0; i < tape_count; ++i) {
+                rule.read_classes[i] = SymbolClass::Parse(TraceIo::GetString(in));
+                rule.write_symbols[i] = static_cast<char>(TraceIo::Get(in, 1));
+                rule.copy_from[i] = static_cast<int8_t>(TraceIo::Get(in, 1));
+                rule.moves[i] = static_cast<int8_t>(TraceIo::Get(in, 1));
+                if (rule.copy_from[i] >= static_cast<int>(tape_count)) {
+                    throw std::runtime_error("Trace header is corrupted");
+                }
+            }
+            action.write.assign(rule.write_symbols.begin(), rule.write_symbols.begin() + tape_count);
+            action.copy_from.assign(rule.copy_from.begin(), rule.copy_from.begin() + tape_count);
+            action.moves.assign(rule.moves.begin(), rule.moves.begin() + tape_count);
+            actions.push_back(action);
+            reads.push_back(rule.ReadText(tape_count));
+            writes.push_back(rule.WriteText(tape_count));
+        }
+    }
+
+    void ReadIndex() {
+        in.seekg(-16, std::ios::end);
+        uint64_t index_offset = TraceIo::Get(in, 8);
+        char magic[8];
+        if (!in.read(magic, 8) || std::string(magic, 8) != std::string(TraceIo::INDEX_MAGIC, 8)) {
+            throw std::runtime_error("Trace file has no index, recording was not closed");
+        }
+
+        in.seekg(static_cast<std::streamoff>(index_offset));
+        total_steps = static_cast<size_t>(TraceIo::Get(in, 8));
+        size_t block_count = static_cast<size_t>(TraceIo::Get(in, 8));
+        for (size_t k = 0; k < block_count; ++k) {
+            BlockEntry entry;
+            entry.offset = TraceIo::Get(in, 8);
+            entry.state = static_cast<uint32_t>(TraceIo::Get(in, 4));
+            for (size_t i = 0; i < tape_count; ++i) {
+                entry.heads.push_back(static_cast<int64_t>(TraceIo::Get(in, 8)));
+            }
+            blocks.push_back(entry);
+        }
+        size_t snapshot_count = static_cast<size_t>(TraceIo::Get(in, 8));
+        for (size_t k = 0; k < snapshot_count; ++k) {
+            SnapshotEntry entry;
+            entry.step = TraceIo::Get(in, 8);
+            entry.offset = TraceIo::Get(in, 8);
+            snapshots.push_back(entry);
+        }
+        if (snapshots.empty() || snapshots.front().step != 0 ||
+            blocks.size() != (total_steps + block_steps - 1) / block_steps) {
+            throw std::runtime_error("Trace index is corrupted");
+        }
+    }
+
+    const std::vector<uint32_t>& LoadBlock(size_t block_index) const {
+        if (block_index == cached_block) {
+            return cached_ids;
+        }
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(blocks[block_index].offset));
+        if (in.get() != TraceIo::BLOCK_RECORD) {
+            throw std::runtime_error("Trace block is corrupted");
+        }
+        std::vector<uint8_t> bytes(static_cast<size_t>(TraceIo::Get(in, 8)));
+        if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+            throw std::runtime_error("Trace file is truncated");
+        }
+
+        size_t count = std::min(block_steps, total_steps - block_index * block_steps);
+        cached_block = SIZE_MAX;
+        cached_ids.clear();
+        cached_ids.reserve(count);
+        TraceBitReader reader(bytes);
+        while (cached_ids.size() < count) {
+            uint32_t id = static_cast<uint32_t>(reader.Get(id_bits));
+            uint64_t run = reader.GetGamma();
+            if (id >= actions.size() || run > count - cached_ids.size()) {
+                throw std::runtime_error("Trace block is corrupted");
+            }
+            cached_ids.insert(cached_ids.end(), static_cast<size_t>(run), id);
+        }
+        cached_block = block_index;
+        return cached_ids;
+    }
+
+    void ReadSnapshot(const SnapshotEntry& entry, uint32_t& state, std::vector<int64_t>& heads,
+        std::vector<TraceTape>& tapes) const {
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(entry.offset));
+        if (in.get() != TraceIo::SNAPSHOT_RECORD || TraceIo::Get(in, 8) != entry.step) {
+            throw std::runtime_error("Trace snapshot is corrupted");
+        }
+        state = static_cast<uint32_t>(TraceIo::Get(in, 4));
+        for (size_t i = 0; i < tape_count; ++i) {
+            heads.push_back(static_cast<int64_t>(TraceIo::Get(in, 8)));
+            int64_t start = static_cast<int64_t>(TraceIo::Get(in, 8));
+            std::string content(static_cast<size_t>(TraceIo::Get(in, 8)), '\0');
+            if (!in.read(&content[0], static_cast<std::streamsize>(content.size()))) {
+                throw std::runtime_error("Trace file is truncated");
+            }
+            tapes.emplace_back(blank, start, content);
+        }
+    }
+};
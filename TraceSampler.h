@@ -0,0 +1,177 @@
+#pragma once
+
+#include "multi_tape_turing_machine.h"
+#include "MachineProfile.h"
+#include "exceptions.h"
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+
+struct SamplerOptions {
+    size_t every_steps = 65536;       // шагов между отсчётами
+    int64_t every_microseconds = 0;   // если > 0, отсчёты по времени, порция шагов подбирается
+};
+
+// Сэмплер для длинных запусков: выполняет машину порциями и между порциями записывает
+// (шаг, состояние, головки, материализованные ячейки) в поток событий Chrome trace JSON.
+// Состояния становятся интервалами (с точностью до отсчёта), рост лент и головки - счётчиками.
+// Файл открывается в chrome://tracing и ui.perfetto.dev
+class TraceSampler {
+private:
+    // Начальная порция шагов в режиме по времени
+    static constexpr size_t INITIAL_TIMED_CHUNK = 4096;
+
+    std::ofstream out;
+    SamplerOptions options;
+    std::chrono::steady_clock::time_point origin;
+    bool first_event;
+    bool span_open;
+    std::string span_state;
+    int64_t span_start;
+    size_t span_first_step;
+    size_t last_step;
+    size_t samples;
+
+public:
+    explicit TraceSampler(const std::string& path, const SamplerOptions& opts = SamplerOptions())
+        : out(path),
+        options(opts),
+        origin(std::chrono::steady_clock::now()),
+        first_event(true),
+        span_open(false),
+        span_start(0),
+        span_first_step(0),
+        last_step(0),
+        samples(0) {
+        if (!out) {
+            throw InvalidArgumentException("Cannot open trace file: " + path);
+        }
+        out << "[\n";
+        WriteEvent(R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"Turing machine"}})");
+        WriteEvent(R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"state"}})");
+    }
+
+    TraceSampler(const TraceSampler&) = delete;
+    TraceSampler& operator=(const TraceSampler&) = delete;
+
+    ~TraceSampler() {
+        Close();
+    }
+
+    // Запуск с отсчётами. Поиск зацикливания включается на всё время запуска
+    // и продолжается через границы порций
+    RunResult Run(TuringMachine& machine, const RunOptions& run_options = RunOptions()) {
+        auto started = std::chrono::steady_clock::now();
+        size_t first_step = machine.GetStepCount();
+        bool timed = options.every_microseconds > 0;
+        size_t chunk = timed ? INITIAL_TIMED_CHUNK : std::max<size_t>(1, options.every_steps);
+
+        bool cycles_for_run = run_options.detect_cycles && !machine.IsCycleDetectionEnabled();
+        if (cycles_for_run) {
+            machine.EnableCycleDetection(true);
+        }
+
+        RunOptions slice = run_options;
+        slice.detect_cycles = false;
+        RunResult result;
+        Sample(machine);
+        while (true) {
+            size_t remaining = run_options.max_steps - (machine.GetStepCount() - first_step);
+            slice.max_steps = std::min(chunk, remaining);
+            RunResult part = machine.Run(slice);
+            slice.resume_cycle_search = true;
+            Sample(machine);
+
+            result.status = part.status;
+            result.cycle_period = part.cycle_period;
+            if (part.status != RunStatus::StepLimit || part.steps < slice.max_steps || slice.max_steps == remaining) {
+                break;
+            }
+
+            if (timed) {
+                // Подстраиваем порцию под заданный интервал, не больше чем вчетверо за раз
+                double spent = std::max(1.0, std::chrono::duration<double, std::micro>(part.elapsed).count());
+                double scale = std::min(4.0, std::max(0.25, static_cast<double>(options.every_microseconds) / spent));
+                chunk = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(chunk) * scale));
+            }
+        }
+
+        if (cycles_for_run) {
+            machine.EnableCycleDetection(false);
+        }
+        result.steps = machine.GetStepCount() - first_step;
+        result.elapsed = std::chrono::steady_clock::now() - started;
+        return result;
+    }
+
+    // Записать один отсчёт
+    void Sample(const TuringMachine& machine) {
+        int64_t now = Timestamp();
+        std::string state = machine.GetCurrentState();
+        size_t step = machine.GetStepCount();
+
+        if (!span_open || state != span_state) {
+            CloseSpan(now);
+            span_open = true;
+            span_state = state;
+            span_start = now;
+            span_first_step = step;
+        }
+        last_step = step;
+
+        std::string ts = std::to_string(now);
+        std::string cells;
+        std::string heads;
+        for (size_t i = 0; i < machine.GetActiveTapeCount(); ++i) {
+            std::string name = "\"tape " + std::to_string(i + 1) + "\":";
+            cells += (i ? "," : "") + name + std::to_string(machine.GetMaterializedCellsCount(i));
+            heads += (i ? "," : "") + name + std::to_string(machine.GetHeadPosition(i));
+        }
+        WriteEvent(R"({"name":"materialized cells","ph":"C","pid":1,"ts":)" + ts + R"(,"args":{)" + cells + "}}");
+        WriteEvent(R"({"name":"head position","ph":"C","pid":1,"ts":)" + ts + R"(,"args":{)" + heads + "}}");
+        WriteEvent(R"({"name":"steps","ph":"C","pid":1,"ts":)" + ts + R"(,"args":{"steps":)" + std::to_string(step) + "}}");
+        samples++;
+    }
+
+    // Завершить последний интервал и закрыть массив событий
+    void Close() {
+        if (!out.is_open()) {
+            return;
+        }
+        CloseSpan(Timestamp());
+        out << "\n]\n";
+        out.close();
+    }
+
+    size_t GetSampleCount() const {
+        return samples;
+    }
+
+private:
+    int64_t Timestamp() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void CloseSpan(int64_t now) {
+        if (!span_open) {
+            return;
+        }
+        WriteEvent(R"({"name":)" + MachineProfile::JsonString(span_state) +
+            R"(,"cat":"state","ph":"X","pid":1,"tid":1,"ts":)" + std::to_string(span_start) +
+            R"(,"dur":)" + std::to_string(std::max<int64_t>(1, now - span_start)) +
+            R"(,"args":{"first_step":)" + std::to_string(span_first_step) +
+            R"(,"last_step":)" + std::to_string(last_step) + "}}");
+        span_open = false;
+    }
+
+    void WriteEvent(const std::string& event) {
+        if (!first_event) {
+            out << ",\n";
+        }
+        out << event;
+        first_event = false;
+    }
+};
@@ -0,0 +1,524 @@
+// Набор замеров производительности без интерфейса.
+// Сборка: g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+//
+// Нагрузки воспроизводимы (фиксированные входы и зёрна генератора):
+//   template/*   - программы TuringTemplates на входах от 10^3 до 10^7 символов
+//   beaver/*     - чемпионы "усердного бобра" с известным числом шагов
+//   compiler/*   - TuringMachineCompiler::Compile на большой случайной программе
+//   tape/*       - BidirectionalLazyTape: случайный и последовательный доступ
+//   container/*  - Sequence: добавление и чтение по индексу
+//
+// Для каждой нагрузки: операций (шагов) в секунду, нс на операцию, пиковый RSS
+// и число выделений памяти на операцию. --json пишет результаты, --baseline сравнивает
+// нс на операцию с сохранённым файлом и завершается с кодом 2 при регрессии
+
+#include "multi_tape_turing_machine.h"
+#include "Compiler.h"
+#include "templates.h"
+#include "BidirectionalLazyTape.h"
+#include "Sequence.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Счётчик выделений памяти: глобальные operator new заменены только в этой программе
+static std::atomic<uint64_t> allocation_count(0);
+
+// Замены не встраиваются: иначе GCC видит в вызывающем коде malloc из new[] рядом с free
+// из delete[] и предупреждает о несовпадающих функциях (-Wmismatched-new-delete)
+#if defined(__GNUC__) || defined(__clang__)
+#define MMT_NOINLINE __attribute__((noinline))
+#else
+#define MMT_NOINLINE
+#endif
+
+MMT_NOINLINE void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+MMT_NOINLINE void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+MMT_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+MMT_NOINLINE void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+MMT_NOINLINE void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+MMT_NOINLINE void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Пиковый размер резидентной памяти процесса
+class PeakMemory {
+public:
+    // Сбросить пик перед нагрузкой (Linux: /proc/self/clear_refs); false, если не поддерживается
+    static bool Reset() {
+#if defined(__linux__)
+        std::ofstream out("/proc/self/clear_refs");
+        out << "5";
+        out.flush();
+        return static_cast<bool>(out);
+#else
+        return false;
+#endif
+    }
+
+    static uint64_t GetKilobytes() {
+#if defined(__linux__)
+        std::ifstream in("/proc/self/status");
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::strtoull(line.c_str() + 6, nullptr, 10);
+            }
+        }
+#endif
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize / 1024;
+        }
+        return 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+    }
+};
+
+struct BenchmarkResult {
+    std::string name;
+    uint64_t operations = 0;   // шагов машины, строк программы или обращений к ленте
+    double seconds = 0;        // лучшее время из повторов
+    uint64_t peak_rss_kb = 0;
+    uint64_t allocations = 0;  // за измеряемую часть лучшего повтора
+
+    double NanosecondsPerOperation() const {
+        return operations ? seconds * 1e9 / static_cast<double>(operations) : 0.0;
+    }
+
+    double OperationsPerSecond() const {
+        return seconds > 0 ? static_cast<double>(operations) / seconds : 0.0;
+    }
+
+    double AllocationsPerOperation() const {
+        return operations ? static_cast<double>(allocations) / static_cast<double>(operations) : 0.0;
+    }
+};
+
+struct BenchmarkOptions {
+    size_t repeat = 3;
+    size_t max_size = 10000000;
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold_percent = 10.0;
+};
+
+// Нагрузка: подготовка вне замера, затем измеряемая часть, возвращающая число операций
+struct Workload {
+    std::string name;
+    std::function<std::function<uint64_t()>()> prepare;
+};
+
+class BenchmarkSuite {
+private:
+    BenchmarkOptions options;
+    std::vector<Workload> workloads;
+    std::vector<BenchmarkResult> results;
+
+public:
+    explicit BenchmarkSuite(const BenchmarkOptions& opts) : options(opts) {
+        AddTemplateWorkloads();
+        AddBusyBeaverWorkloads();
+        AddCompilerWorkloads();
+        AddTapeWorkloads();
+        AddContainerWorkloads();
+    }
+
+    void Run() {
+        bool resettable = PeakMemory::Reset();
+        if (!resettable) {
+            std::cout << "note: peak RSS cannot be reset, values are cumulative\n";
+        }
+        std::printf("%-44s %14s %12s %12s %12s %10s\n", "workload", "operations", "ns/op", "ops/s", "peak RSS KB", "allocs/op");
+
+        for (const Workload& workload : workloads) {
+            if (!options.filter.empty() && workload.name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            PeakMemory::Reset();
+
+            BenchmarkResult result;
+            result.name = workload.name;
+            for (size_t r = 0; r < std::max<size_t>(1, options.repeat); ++r) {
+                std::function<uint64_t()> body = workload.prepare();
+                uint64_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+                auto started = std::chrono::steady_clock::now();
+                uint64_t operations = body();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+                uint64_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+                if (r == 0 || seconds < result.seconds) {
+                    result.seconds = seconds;
+                    result.operations = operations;
+                    result.allocations = allocations;
+                }
+            }
+            result.peak_rss_kb = PeakMemory::GetKilobytes();
+            results.push_back(result);
+
+            std::printf("%-44s %14llu %12.2f %12.4g %12llu %10.4f\n", result.name.c_str(),
+                static_cast<unsigned long long>(result.operations), result.NanosecondsPerOperation(),
+                result.OperationsPerSecond(), static_cast<unsigned long long>(result.peak_rss_kb),
+                result.AllocationsPerOperation());
+            std::fflush(stdout);
+        }
+    }
+
+    std::string ToJson() const {
+        std::stringstream ss;
+        ss << "{\"results\":[\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchmarkResult& r = results[i];
+            ss << (i ? ",\n" : "") << "{\"name\":" << MachineProfile::JsonString(r.name)
+                << ",\"operations\":" << r.operations
+                << ",\"seconds\":" << r.seconds
+                << ",\"ns_per_op\":" << r.NanosecondsPerOperation()
+                << ",\"ops_per_sec\":" << r.OperationsPerSecond()
+                << ",\"peak_rss_kb\":" << r.peak_rss_kb
+                << ",\"allocations_per_op\":" << r.AllocationsPerOperation() << "}";
+        }
+        ss << "\n]}\n";
+        return ss.str();
+    }
+
+    // Сравнение нс на операцию с базовым файлом; true, если регрессий больше порога нет
+    bool CompareWithBaseline(const std::string& path) const {
+        std::map<std::string, double> baseline = ReadBaseline(path);
+        bool ok = true;
+        std::printf("\n%-44s %12s %12s %9s\n", "workload", "baseline", "current", "change");
+        for (const BenchmarkResult& r : results) {
+            auto it = baseline.find(r.name);
+            if (it == baseline.end() || it->second <= 0) {
+                std::printf("%-44s %12s %12.2f %9s\n", r.name.c_str(), "-", r.NanosecondsPerOperation(), "new");
+                continue;
+            }
+            double change = (r.NanosecondsPerOperation() / it->second - 1.0) * 100.0;
+            bool regression = change > options.threshold_percent;
+            ok = ok && !regression;
+            std::printf("%-44s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), it->second,
+                r.NanosecondsPerOperation(), change, regression ? "  REGRESSION" : "");
+        }
+        return ok;
+    }
+
+private:
+    // Размеры входов: 10^3, 10^4, ... до max_size
+    std::vector<size_t> InputSizes() const {
+        std::vector<size_t> sizes;
+        for (size_t n = 1000; n <= options.max_size && n <= 10000000; n *= 10) {
+            sizes.push_back(n);
+        }
+        return sizes;
+    }
+
+    static std::string EngineName(ExecutionEngine engine) {
+        return engine == ExecutionEngine::Threaded ? "threaded" : "interpreter";
+    }
+
+    // Программа шаблона на трёх лентах, запускается до принимающего состояния
+    void AddTemplate(const std::string& name, const std::string& code, const std::string& accept,
+        std::function<std::string(size_t)> input) {
+        for (ExecutionEngine engine : { ExecutionEngine::Interpreter, ExecutionEngine::Threaded }) {
+            for (size_t size : InputSizes()) {
+                std::string label = "template/" + name + "/" + EngineName(engine) + "/" + std::to_string(size);
+                workloads.push_back({ label, [=]() {
+                    std::string error;
+                    Sequence<TuringMachineCompiler::ParsedTransition> transitions = TuringMachineCompiler::Compile(code, 3, error);
+                    std::shared_ptr<TuringMachine> machine = CreateTuringMachine("q0", 3, ' ', SIZE_MAX, engine);
+                    for (size_t i = 0; i < transitions.GetSize(); ++i) {
+                        TuringMachineCompiler::AddToMachine(*machine, transitions[i]);
+                    }
+                    machine->SetAcceptState(accept);
+                    machine->InitializeTape(0, input(size));
+                    machine->Finalize();
+                    return std::function<uint64_t()>([machine, label]() {
+                        if (!machine->Run()) {
+                            throw std::runtime_error(label + " did not accept");
+                        }
+                        return static_cast<uint64_t>(machine->GetStepCount());
+                    });
+                } });
+            }
+        }
+    }
+
+    void AddTemplateWorkloads() {
+        auto cycle = [](const std::string& alphabet) {
+            return [alphabet](size_t n) {
+                std::string s(n, ' ');
+                for (size_t i = 0; i < n; ++i) s[i] = alphabet[(i * 7 + i / 3) % alphabet.size()];
+                return s;
+            };
+        };
+        std::string letters = "abcdefghijklmnopqrstuvwxyz";
+        AddTemplate("copy-english", TuringTemplates::CopyEnglishAlphabet(), "q1", cycle(letters));
+        AddTemplate("copy-alphanumeric", TuringTemplates::CopyAlphanumeric(), "q1",
+            cycle("ABCDEFGHIJKLMNOPQRSTUVWXYZ" + letters + "0123456789"));
+        AddTemplate("binary-inverter", TuringTemplates::BinaryInverter(), "q1", cycle("0110"));
+        AddTemplate("binary-inverter-2", TuringTemplates::BinaryInverter2Tapes(), "q1", cycle("0110"));
+        AddTemplate("unary-addition", TuringTemplates::UnaryAddition(), "q2", [](size_t n) {
+            std::string s(n, '1');
+            s[n / 2] = '+';
+            return s;
+        });
+        AddTemplate("binary-counter", TuringTemplates::BinaryCounter(), "q1", cycle("1011"));
+        AddTemplate("simple-copy", TuringTemplates::SimpleCopy(), "q1", [](size_t n) { return std::string(n, 'a'); });
+    }
+
+    // Чемпионы с двумя символами: строки "A0 A1 B0 B1 ...", переход - запись, сдвиг, состояние; H - останов
+    void AddBusyBeaver(const std::string& name, const std::vector<std::string>& table, uint64_t expected_steps) {
+        for (ExecutionEngine engine : { ExecutionEngine::Interpreter, ExecutionEngine::Threaded }) {
+            std::string label = "beaver/" + name + "/" + EngineName(engine);
+            workloads.push_back({ label, [=]() {
+                std::shared_ptr<TuringMachine> machine = CreateTuringMachine("A", 1, '0', SIZE_MAX, engine);
+                for (size_t k = 0; k < table.size(); ++k) {
+                    std::string from(1, static_cast<char>('A' + k / 2));
+                    std::array<char, TuringMachine::MAX_TAPES> read = {};
+                    std::array<char, TuringMachine::MAX_TAPES> write = {};
+                    std::array<int, TuringMachine::MAX_TAPES> move = {};
+                    read[0] = static_cast<char>('0' + k % 2);
+                    write[0] = table[k][0];
+                    move[0] = table[k][1] == 'R' ? 1 : -1;
+                    machine->AddTransition(from, read, std::string(1, table[k][2]), write, move);
+                }
+                machine->SetAcceptState("H");
+                machine->Finalize();
+                // Короткие машины прогоняются многократно, чтобы замер был не меньше миллиона шагов
+                uint64_t rounds = std::max<uint64_t>(1, 1000000 / expected_steps);
+                return std::function<uint64_t()>([machine, label, rounds, expected_steps]() {
+                    uint64_t steps = 0;
+                    for (uint64_t r = 0; r < rounds; ++r) {
+                        machine->Reset();
+                        machine->Run();
+                        if (machine->GetStepCount() != expected_steps) {
+                            throw std::runtime_error(label + " made " + std::to_string(machine->GetStepCount()) + " steps");
+                        }
+                        steps += machine->GetStepCount();
+                    }
+                    return steps;
+                });
+            } });
+        }
+    }
+
+    void AddBusyBeaverWorkloads() {
+        AddBusyBeaver("bb2", { "1RB", "1LB", "1LA", "1RH" }, 6);
+        AddBusyBeaver("bb3", { "1RB", "1RH", "1LB", "0RC", "1LC", "1LA" }, 21);
+        AddBusyBeaver("bb4", { "1RB", "1LB", "1LA", "0LC", "1RH", "1LD", "1RD", "0RA" }, 107);
+        AddBusyBeaver("bb5", { "1RB", "1LC", "1RC", "1RB", "1RD", "0LE", "1LA", "1LD", "1RH", "0LA" }, 47176870);
+    }
+
+    void AddCompilerWorkloads() {
+        for (size_t lines : { size_t(10000), size_t(100000) }) {
+            std::string label = "compiler/random-3-tapes/" + std::to_string(lines);
+            workloads.push_back({ label, [=]() {
+                std::mt19937 rng(12345);
+                std::string symbols = "01abcxyz+ ";
+                std::string moves = "LRS";
+                std::string code = "# generated\n";
+                for (size_t i = 0; i < lines; ++i) {
+                    code += "q" + std::to_string(rng() % 1000);
+                    for (int k = 0; k < 3; ++k) code += std::string(",") + symbols[rng() % symbols.size()];
+                    code += " -> q" + std::to_string(rng() % 1000);
+                    for (int k = 0; k < 3; ++k) code += std::string(",") + symbols[rng() % symbols.size()];
+                    for (int k = 0; k < 3; ++k) code += std::string(",") + moves[rng() % 3];
+                    code += "\n";
+                }
+                return std::function<uint64_t()>([code, label, lines]() {
+                    std::string error;
+                    Sequence<TuringMachineCompiler::ParsedTransition> parsed = TuringMachineCompiler::Compile(code, 3, error);
+                    if (!error.empty() || parsed.GetSize() != lines) {
+                        throw std::runtime_error(label + " failed to parse");
+                    }
+                    return static_cast<uint64_t>(lines);
+                });
+            } });
+        }
+    }
+
+    void AddTapeWorkloads() {
+        const uint64_t operations = 1000000;
+        workloads.push_back({ "tape/sequential-write-read", [=]() {
+            auto tape = std::make_shared<BidirectionalLazyTape<char>>(' ');
+            return std::function<uint64_t()>([tape, operations]() {
+                int count = static_cast<int>(operations / 2);
+                for (int i = 0; i < count; ++i) tape->Set(i, static_cast<char>('a' + i % 26));
+                unsigned sum = 0;
+                for (int i = 0; i < count; ++i) sum += static_cast<unsigned char>(tape->Get(i));
+                if (sum == 0) throw std::runtime_error("tape is empty");
+                return operations;
+            });
+        } });
+        workloads.push_back({ "tape/random-access", [=]() {
+            auto tape = std::make_shared<BidirectionalLazyTape<char>>(' ');
+            auto positions = std::make_shared<std::vector<int>>(operations);
+            std::mt19937 rng(777);
+            for (int& p : *positions) p = static_cast<int>(rng() % 200001) - 100000;
+            return std::function<uint64_t()>([tape, positions]() {
+                unsigned sum = 0;
+                for (size_t i = 0; i < positions->size(); ++i) {
+                    int p = (*positions)[i];
+                    if (i & 1) tape->Set(p, 'x');
+                    else sum += static_cast<unsigned char>(tape->Get(p));
+                }
+                if (sum == 0) throw std::runtime_error("tape is empty");
+                return static_cast<uint64_t>(positions->size());
+            });
+        } });
+        // Пробег по длинному однородному участку туда и обратно: страницы идут по ячейкам,
+        // отрезки - целыми участками
+        for (TapeStorage storage : { TapeStorage::Paged, TapeStorage::RunLength }) {
+            std::string label = std::string("tape/long-sweep/") + (storage == TapeStorage::Paged ? "paged" : "run-length");
+            workloads.push_back({ label, [=]() {
+                auto tape = std::make_shared<BidirectionalLazyTape<char>>('0', storage);
+                return std::function<uint64_t()>([tape]() {
+                    const size_t cells = size_t(1) << 24;
+                    std::array<uint8_t, 256> matches = {};
+                    std::array<char, 256> rewrite;
+                    for (size_t c = 0; c < rewrite.size(); ++c) rewrite[c] = static_cast<char>(c);
+                    tape->ClearMaterialized();
+                    int64_t position = 0;
+                    matches['0'] = 1;
+                    rewrite['0'] = '1';
+                    size_t forward = tape->Sweep(position, 1, matches.data(), rewrite.data(), cells);
+                    matches['0'] = 0;
+                    matches['1'] = 1;
+                    rewrite['1'] = '0';
+                    position--;
+                    size_t back = tape->Sweep(position, -1, matches.data(), rewrite.data(), cells);
+                    if (forward != cells || back != cells) throw std::runtime_error("sweep stopped early");
+                    return static_cast<uint64_t>(forward + back);
+                });
+            } });
+        }
+    }
+
+    void AddContainerWorkloads() {
+        workloads.push_back({ "container/sequence-append-index", []() {
+            return std::function<uint64_t()>([]() {
+                const size_t count = 1000000;
+                Sequence<int> sequence;
+                for (size_t i = 0; i < count; ++i) sequence.Append(static_cast<int>(i));
+                long long sum = 0;
+                for (size_t i = 0; i < count; ++i) sum += sequence[i];
+                if (sum != static_cast<long long>(count) * (count - 1) / 2) throw std::runtime_error("sequence sum");
+                return static_cast<uint64_t>(2 * count);
+            });
+        } });
+    }
+
+    // Пары "name" / "ns_per_op" из файла, записанного ToJson
+    static std::map<std::string, double> ReadBaseline(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            throw InvalidArgumentException("Cannot open baseline: " + path);
+        }
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string text = ss.str();
+
+        std::map<std::string, double> baseline;
+        size_t position = 0;
+        while ((position = text.find("\"name\":\"", position)) != std::string::npos) {
+            position += 8;
+            size_t end = text.find('"', position);
+            size_t value = text.find("\"ns_per_op\":", end);
+            if (end == std::string::npos || value == std::string::npos) break;
+            baseline[text.substr(position, end - position)] = std::strtod(text.c_str() + value + 12, nullptr);
+            position = end;
+        }
+        return baseline;
+    }
+};
+
+static void PrintUsage() {
+    std::cout << "usage: benchmark [--filter TEXT] [--repeat N] [--max-size N] [--quick]\n"
+        << "                 [--json FILE] [--baseline FILE] [--threshold PERCENT]\n";
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value) options.filter = argv[++i];
+        else if (arg == "--repeat" && has_value) options.repeat = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--max-size" && has_value) options.max_size = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--quick") options.max_size = 100000, options.repeat = 1;
+        else if (arg == "--json" && has_value) options.json_path = argv[++i];
+        else if (arg == "--baseline" && has_value) options.baseline_path = argv[++i];
+        else if (arg == "--threshold" && has_value) options.threshold_percent = std::strtod(argv[++i], nullptr);
+        else {
+            PrintUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    try {
+        BenchmarkSuite suite(options);
+        suite.Run();
+
+        if (!options.json_path.empty()) {
+            std::ofstream out(options.json_path);
+            out << suite.ToJson();
+            if (!out) {
+                std::cerr << "Cannot write " << options.json_path << "\n";
+                return 1;
+            }
+        }
+        if (!options.baseline_path.empty() && !suite.CompareWithBaseline(options.baseline_path)) {
+            return 2;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
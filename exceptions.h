@@ -82,4 +82,23 @@ public:
     }
 };
 
+class InfiniteLoopException : public std::exception {
+private:
+    std::string message;
+    size_t period;
+public:
+    InfiniteLoopException(size_t cycle_period)
+        : message("Machine loops forever with period " + std::to_string(cycle_period)),
+        period(cycle_period) {
+    }
+
+    size_t GetPeriod() const {
+        return period;
+    }
+
+    const char* what() const noexcept override {
+        return message.c_str();
+    }
+};
+
 #endif // EXCEPTIONS_H
\ No newline at end of file
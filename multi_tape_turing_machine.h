@@ -4,8 +4,13 @@
 #include "exceptions.h"
 #include "BidirectionalLazyTape.h"
 #include "identifier.h"
+#include "MachineProfile.h"
+#include "SymbolClass.h"
 #include <unordered_map>  
+#include <map>
+#include <vector>
 #include <set>
+#include <deque>
 #include <string>
 #include <memory>
 #include <stdexcept>
@@ -14,15 +19,85 @@
 #include <sstream>
 #include <array>
 #include <limits>  
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <algorithm>
 
-class MultiTapeTuringMachine {
-public:
-    static constexpr size_t MAX_TAPES = 3;
+#if defined(__GNUC__) || defined(__clang__)
+#define MMT_COMPUTED_GOTO 1
+#else
+#define MMT_COMPUTED_GOTO 0
+#endif
 
-    const BidirectionalLazyTape<char>* GetTape(size_t i) const {
-        if (i >= active_tapes) throw InvalidTapeException();
-        return &tapes[i];
+// Механизм выполнения программы
+enum class ExecutionEngine {
+    Interpreter, // цикл с поиском в таблице переходов (эталонный)
+    Threaded     // потоковый код: блок на каждое состояние, прямые переходы по прочитанным символам
+};
+
+// Ограничения журнала шагов
+struct JournalOptions {
+    size_t max_entries = size_t(1) << 20;     // записей о шагах
+    size_t checkpoint_interval = 65536;       // шагов между полными снимками
+    size_t max_checkpoints = 64;              // старые снимки отбрасываются
+};
+
+// Причина остановки запуска
+enum class RunStatus {
+    Accepted,   // достигнуто допускающее состояние
+    Halted,     // нет перехода из текущей конфигурации
+    StepLimit,  // исчерпан лимит шагов запуска или машины
+    Cycle,      // найдено зацикливание
+    Cancelled   // запуск отменён флагом cancel
+};
+
+inline const char* RunStatusName(RunStatus status) {
+    switch (status) {
+    case RunStatus::Accepted: return "accepted";
+    case RunStatus::Halted: return "halted";
+    case RunStatus::StepLimit: return "step-limit";
+    case RunStatus::Cycle: return "cycle";
+    default: return "cancelled";
     }
+}
+
+struct RunOptions {
+    size_t max_steps = std::numeric_limits<size_t>::max();  // шагов за запуск; предел машины тоже действует
+    bool detect_cycles = false;  // искать зацикливание только в этом запуске
+    const std::atomic<bool>* cancel = nullptr;  // проверяется между порциями шагов
+    // Продолжить поиск зацикливания предыдущего запуска, а не начинать заново: для запуска
+    // порциями, между которыми машину не меняли
+    bool resume_cycle_search = false;
+};
+
+struct RunResult {
+    RunStatus status = RunStatus::Halted;
+    size_t steps = 0;  // шагов, выполненных этим запуском
+    std::chrono::steady_clock::duration elapsed{};
+    size_t cycle_period = 0;  // для RunStatus::Cycle
+
+    bool IsAccepted() const {
+        return status == RunStatus::Accepted;
+    }
+};
+
+// Приёмник номеров выполненных переходов (запись трассы).
+// Номер - индекс в GetCompiledTransitions
+class StepSink {
+public:
+    virtual ~StepSink() = default;
+
+    // Забрать накопленные номера; содержимое вектора можно обменять
+    virtual void Consume(std::vector<uint32_t>& steps) = 0;
+};
+
+// Общая часть машины, не зависящая от числа лент: программа, состояния, счётчики.
+// Ленты и исполнение - в MultiTapeTuringMachine<N>, экземпляр выбирает CreateTuringMachine
+class TuringMachine {
+public:
+    static constexpr size_t MAX_TAPES = 8;
 
     struct Transition {
         std::string state_from;
@@ -49,12 +124,16 @@ public:
             write_symbols(write), moves(move) {
         }
 
+        // Переход для трёх лент, остальные ленты читают и пишут пробел
         Transition(const std::string& from,
             char r0, char r1, char r2,
             const std::string& to,
             char w0, char w1, char w2,
             int m0, int m1, int m2)
             : state_from(from), state_to(to) {
+            read_symbols.fill(' ');
+            write_symbols.fill(' ');
+            moves.fill(0);
             read_symbols[0] = r0;
             read_symbols[1] = r1;
             read_symbols[2] = r2;
@@ -67,44 +146,101 @@ public:
         }
     };
 
-private:
-    std::map<std::pair<std::string, std::array<char, MAX_TAPES>>, Transition> transitions;
-    std::string current_state;
-    std::array<int, MAX_TAPES> head_positions;
-    std::array<BidirectionalLazyTape<char>, MAX_TAPES> tapes;
-    std::string start_state;
-    std::set<std::string> accept_states;
-    std::set<std::string> all_states;
-    char blank_symbol;
-    size_t step_count;
-    size_t max_steps;
-    size_t active_tapes;
+    // Переход с классами символов: хранится одной записью, при компиляции раскрывается
+    // в таблицу по классам эквивалентности символов. copy_from[i] >= 0 - на ленту i
+    // записывается символ, прочитанный на ленте copy_from[i] (в языке "=" и "=k").
+    // Непустой call - переход-вызов вложенной машины, state_to - состояние после возврата
+    struct PatternTransition {
+        std::string state_from;
+        std::array<SymbolClass, MAX_TAPES> read_classes;  // пустой класс - лента не указана
+        std::string state_to;
+        std::array<char, MAX_TAPES> write_symbols;
+        std::array<int, MAX_TAPES> copy_from;
+        std::array<int, MAX_TAPES> moves;
+        std::string call;
 
-public:
-    MultiTapeTuringMachine(const std::string& start,
-        size_t num_tapes = 1,
-        char blank = ' ',
-        size_t max_steps_limit = 1000000)
-        : current_state(start),
-        blank_symbol(blank),
-        start_state(start),
-        step_count(0),
-        max_steps(max_steps_limit),
-        active_tapes(num_tapes) {
+        PatternTransition() {
+            write_symbols.fill(' ');
+            copy_from.fill(-1);
+            moves.fill(0);
+        }
 
-        if (num_tapes < 1 || num_tapes > MAX_TAPES) {
-            throw std::invalid_argument("Number of tapes must be between 1 and 3");
+        // Обычный переход как переход из одиночных классов
+        explicit PatternTransition(const Transition& t)
+            : state_from(t.state_from), state_to(t.state_to),
+            write_symbols(t.write_symbols), moves(t.moves) {
+            copy_from.fill(-1);
+            for (size_t i = 0; i < MAX_TAPES; ++i) {
+                read_classes[i] = SymbolClass::Single(t.read_symbols[i]);
+            }
         }
 
-        for (size_t i = 0; i < MAX_TAPES; ++i) {
-            tapes[i] = BidirectionalLazyTape<char>(blank);
-            head_positions[i] = 0;
+        // Читаемые символы первых tapes лент; классы из нескольких символов разделяются запятыми
+        std::string ReadText(size_t tapes) const {
+            bool single = true;
+            for (size_t i = 0; i < tapes; ++i) {
+                single = single && read_classes[i].GetText().size() == 1;
+            }
+            std::string result;
+            for (size_t i = 0; i < tapes; ++i) {
+                result += (single || i == 0 ? "" : ",") + read_classes[i].GetText();
+            }
+            return result;
         }
 
-        all_states.insert(start);
-    }
+        // Записываемые символы; копирование выглядит как "=" (своя лента) или "=k",
+        // вызов - как "call имя"
+        std::string WriteText(size_t tapes) const {
+            if (!call.empty()) {
+                return "call " + call;
+            }
+            bool single = true;
+            for (size_t i = 0; i < tapes; ++i) {
+                single = single && (copy_from[i] < 0 || copy_from[i] == static_cast<int>(i));
+            }
+            std::string result;
+            for (size_t i = 0; i < tapes; ++i) {
+                std::string symbol = copy_from[i] < 0 ? std::string(1, write_symbols[i])
+                    : copy_from[i] == static_cast<int>(i) ? "=" : "=" + std::to_string(copy_from[i] + 1);
+                result += (single || i == 0 ? "" : ",") + symbol;
+            }
+            return result;
+        }
+    };
+
+    struct TapeStatistics {
+        size_t tape_index;
+        size_t materialized_cells;
+        size_t modified_cells;
+        int64_t min_index;
+        int64_t max_index;
+        int64_t current_position;
+
+        std::string ToString() const {
+            std::stringstream ss;
+            ss << "Tape " << (tape_index + 1) << " Statistics:\n"
+                << "  Materialized cells: " << materialized_cells << "\n"
+                << "  Modified cells: " << modified_cells << "\n"
+                << "  Min index: " << min_index << "\n"
+                << "  Max index: " << max_index << "\n"
+                << "  Current position: " << current_position;
+            return ss.str();
+        }
+    };
+
+    virtual ~TuringMachine() = default;
+
+    // Копия машины вместе с лентами; скомпилированная программа разделяется
+    virtual std::unique_ptr<TuringMachine> Clone() const = 0;
+
+    // Независимая машина в той же конфигурации. Страницы лент разделяются и копируются
+    // при первой записи с любой стороны, поэтому ответвление стоит O(затронутых страниц).
+    // Журнал начинается заново, приёмник шагов не переносится
+    virtual std::unique_ptr<TuringMachine> Fork() const = 0;
 
-    // Добавить переход (все ленты) 
+    virtual const BidirectionalLazyTape<char>* GetTape(size_t i) const = 0;
+
+    // Добавить переход (все ленты)
     void AddTransition(const std::string& from,
         const std::array<char, MAX_TAPES>& read,
         const std::string& to,
@@ -112,11 +248,68 @@ public:
         const std::array<int, MAX_TAPES>& moves) {
         Transition t(from, read, to, write, moves);
         transitions[{from, read}] = t;
-        all_states.insert(from);
-        all_states.insert(to);
+        InternState(from);
+        InternState(to);
+        program_dirty = true;
+        ResetJournal();
+    }
+
+    // Добавить переход с классами символов. Обычные переходы имеют приоритет,
+    // среди переходов с классами срабатывает добавленный раньше
+    void AddTransition(const PatternTransition& t) {
+        for (size_t i = 0; i < active_tapes; ++i) {
+            if (t.copy_from[i] >= static_cast<int>(active_tapes)) {
+                throw InvalidTapeException();
+            }
+        }
+        pattern_transitions.push_back(t);
+        InternState(t.state_from);
+        InternState(t.state_to);
+        program_dirty = true;
+        ResetJournal();
+    }
+
+    // Переход-вызов: из состояния from при любых символах вызывается машина name,
+    // после её возврата машина продолжает с состояния to
+    void AddCall(const std::string& from, const std::string& name, const std::string& to) {
+        PatternTransition t;
+        t.state_from = from;
+        t.state_to = to;
+        t.call = name;
+        for (size_t i = 0; i < active_tapes; ++i) {
+            t.read_classes[i] = SymbolClass::Any();
+            t.copy_from[i] = static_cast<int>(i);
+        }
+        AddTransition(t);
+    }
+
+    // Вложенная машина для переходов-вызовов. Она работает на лентах и головках вызывающей
+    // машины и возвращается, придя в своё допускающее состояние; вызов и возврат - по шагу.
+    // Её программа компилируется один раз и разделяется всеми вызывающими машинами.
+    // Вложенная машина может вызывать свои вложенные машины, рекурсия запрещена
+    void AddSubMachine(const std::string& name, std::shared_ptr<TuringMachine> machine) {
+        if (!machine || machine->active_tapes != active_tapes) {
+            throw InvalidTapeException("Sub-machine must have the same number of tapes");
+        }
+        if (machine->blank_symbol != blank_symbol) {
+            throw InvalidArgumentException("Sub-machine must use the same blank symbol");
+        }
+        if (machine.get() == this || machine->UsesSubMachine(*this)) {
+            throw InvalidArgumentException("Recursive sub-machine call: " + name);
+        }
+        sub_machines[name] = { std::move(machine), 0 };
+        program_dirty = true;
+        ResetJournal();
+    }
+
+    bool HasSubMachines() const {
+        return !sub_machines.empty();
     }
 
-    // Добавить переход (по одной ленте) 
+    // Глубина вложенности текущего вызова; 0 - выполняется сама машина
+    virtual size_t GetCallDepth() const = 0;
+
+    // Добавить переход (по одной ленте)
     void AddTransitionForTape(const std::string& from,
         size_t tape_idx,
         char read_sym,
@@ -138,6 +331,7 @@ public:
                 write_array = it->second.write_symbols;
                 move_array = it->second.moves;
                 transitions.erase(it);
+                program_dirty = true;
                 break;
             }
             ++it;
@@ -151,18 +345,42 @@ public:
     }
 
     void SetAcceptState(const std::string& state) {
-        accept_states.insert(state);
-        all_states.insert(state);
+        uint32_t id = InternState(state);
+        accept_bitmap[id >> 6] |= uint64_t(1) << (id & 63);
+        program_dirty = true;
     }
 
-    void InitializeTape(size_t tape_idx, const std::string& input) {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
-        }
-        head_positions[tape_idx] = 0;
-        tapes[tape_idx].Initialize(input);
+    // Компиляция программы в плоскую таблицу переходов.
+    // Вызывается автоматически перед выполнением, если программа изменилась
+    virtual void Finalize() = 0;
+
+    virtual void InitializeTape(size_t tape_idx, const std::string& input) = 0;
+
+    // Вход без копирования: ячейки читаются из input, пока в них не запишут
+    virtual void InitializeTape(size_t tape_idx, std::shared_ptr<TapeInput> input) = 0;
+
+    // Вход из файла, отображённого в память только для чтения; подходит для входов в гигабайты
+    void InitializeTapeFromFile(size_t tape_idx, const std::string& path) {
+        InitializeTape(tape_idx, TapeInput::FromFile(path));
+    }
+
+    // Вход из чужой памяти; она должна пережить машину, её копии и снимки журнала
+    void InitializeTapeFromView(size_t tape_idx, std::string_view view) {
+        InitializeTape(tape_idx, TapeInput::FromView(view));
     }
 
+    // Вход из канала или stdin: читается в фоне по мере движения головки вправо,
+    // машина запускается сразу, не дожидаясь конца потока
+    void InitializeTapeFromStream(size_t tape_idx, int fd) {
+        InitializeTape(tape_idx, TapeInput::FromStream(fd));
+    }
+
+    // Способ хранения ленты (по умолчанию страницы). Содержимое сохраняется, журнал сбрасывается.
+    // RunLength - для длинных однородных участков: пробег по ним идёт отрезками, а не ячейками
+    virtual void SetTapeStorage(size_t tape_idx, TapeStorage storage) = 0;
+
+    virtual TapeStorage GetTapeStorage(size_t tape_idx) const = 0;
+
     void InitializeTapes(const Sequence<std::string>& inputs) {
         if (inputs.GetSize() != active_tapes) {
             throw std::invalid_argument("Number of inputs must match number of active tapes");
@@ -172,111 +390,188 @@ public:
         }
     }
 
-    bool ExecuteStep() {
-        if (step_count >= max_steps) {
-            throw std::runtime_error("Maximum steps exceeded");
-        }
+    virtual bool ExecuteStep() = 0;
 
-        std::array<char, MAX_TAPES> current_symbols;
-        current_symbols.fill(blank_symbol);
+    // Журнал шагов для отката и перемотки. Хранит компактную запись о каждом шаге
+    // и периодические полные снимки; память ограничена JournalOptions
+    void EnableJournal(bool enabled, const JournalOptions& options = JournalOptions()) {
+        journaling = enabled;
+        journal_options = options;
+        ResetJournal();
+    }
 
-        for (size_t i = 0; i < active_tapes; ++i) {
-            current_symbols[i] = tapes[i].Get(head_positions[i]);
-        }
+    bool IsJournalEnabled() const {
+        return journaling;
+    }
 
-        auto key = std::make_pair(current_state, current_symbols);
-        auto it = transitions.find(key);
+    // Самый ранний шаг, к которому можно вернуться
+    virtual size_t GetEarliestReachableStep() const = 0;
 
-        if (it == transitions.end()) {
+    bool StepBack() {
+        if (!journaling || step_count == 0) {
             return false;
         }
+        return SeekToStep(step_count - 1);
+    }
 
-        const Transition& t = it->second;
+    // Перейти к шагу n: назад - откатом по журналу или от ближайшего снимка с повторным
+    // выполнением не более checkpoint_interval шагов, вперёд - обычным выполнением.
+    // Возвращает false, если машина остановилась раньше шага n
+    virtual bool SeekToStep(size_t n) = 0;
 
-        for (size_t i = 0; i < active_tapes; ++i) {
-            tapes[i].Set(head_positions[i], t.write_symbols[i]);
-            head_positions[i] += t.moves[i];
-        }
+    bool Run() {
+        return FinishRun(Execute(std::numeric_limits<size_t>::max()));
+    }
 
-        current_state = t.state_to;
-        step_count++;
-        return true;
+    bool Run(size_t max_steps_override) {
+        return FinishRun(Execute(max_steps_override));
     }
 
-    bool Run() {
+    // Запуск без исключений: результат сообщает причину остановки, число шагов и время.
+    // При заданном cancel шаги выполняются порциями по CANCEL_CHECK_INTERVAL,
+    // поиск зацикливания продолжается через границы порций
+    RunResult Run(const RunOptions& options) {
+        auto started = std::chrono::steady_clock::now();
+        size_t first_step = step_count;
+        bool cycles_for_run = options.detect_cycles && !detect_cycles;
+        if (cycles_for_run) {
+            EnableCycleDetection(true);
+        }
+
+        RunResult result;
+        size_t remaining = options.max_steps;
+        bool resume = options.resume_cycle_search;
         while (true) {
-            if (accept_states.count(current_state)) {
-                return true;
+            if (options.cancel && options.cancel->load(std::memory_order_relaxed)) {
+                result.status = RunStatus::Cancelled;
+                break;
             }
-            if (!ExecuteStep()) {
-                return false;
+            size_t slice = options.cancel ? std::min(remaining, CANCEL_CHECK_INTERVAL) : remaining;
+            size_t before = step_count;
+            cycle_resume = resume;
+            resume = true;
+            StopReason reason = Execute(slice);
+            remaining -= step_count - before;
+            if (reason == StopReason::StepLimit && remaining > 0) {
+                continue;
             }
+            result.status = ToRunStatus(reason);
+            break;
         }
-    }
 
-    bool Run(size_t max_steps_override) {
-        size_t local_step_count = 0;
-        while (local_step_count < max_steps_override) {
-            if (accept_states.count(current_state)) {
-                return true;
-            }
-            if (!ExecuteStep()) {
-                return false;
-            }
-            local_step_count++;
+        cycle_resume = false;
+        if (cycles_for_run) {
+            EnableCycleDetection(false);
         }
-        throw std::runtime_error("Maximum steps exceeded");
+        result.steps = step_count - first_step;
+        result.cycle_period = result.status == RunStatus::Cycle ? cycle_period : 0;
+        result.elapsed = std::chrono::steady_clock::now() - started;
+        return result;
     }
 
-    std::string GetTapeContent(size_t tape_idx, int from = -10, int to = 10) const {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
+    // Есть ли переход из текущей конфигурации и не исчерпан ли лимит шагов
+    virtual bool CanStep() = 0;
+
+    ExecutionEngine GetExecutionEngine() const {
+        return engine;
+    }
+
+    // Поиск зацикливания в Run: хэш конфигурации (состояние, головки, содержимое лент)
+    // проверяется по схеме Брента, при повторе Run бросает InfiniteLoopException
+    virtual void EnableCycleDetection(bool enabled) = 0;
+
+    bool IsCycleDetectionEnabled() const {
+        return detect_cycles;
+    }
+
+    size_t GetCyclePeriod() const {
+        return cycle_period;
+    }
+
+    virtual uint64_t GetConfigurationHash() const = 0;
+
+    // Профилирование: сколько раз сработал каждый переход, сколько шагов выполнено в каждом
+    // состоянии и как далеко уходили головки. Run с профилированием идёт по инструментированному
+    // циклу без ускорения пробегов. Счётчики копятся до ResetProfile или перекомпиляции программы
+    void EnableProfiling(bool enabled) {
+        profiling = enabled;
+        ResetProfile();
+    }
+
+    bool IsProfilingEnabled() const {
+        return profiling;
+    }
+
+    virtual void ResetProfile() = 0;
+
+    virtual MachineProfile GetProfile() const = 0;
+
+    // Передавать номера выполненных переходов приёмнику. Пока приёмник подключён, Run идёт
+    // по инструментированному циклу. Откат шагов, изменение программы и внешние механизмы
+    // выполнения в запись не попадают; номера шагов вложенных машин - из их программ
+    void SetStepSink(StepSink* sink) {
+        FlushSteps();
+        step_sink = sink;
+        step_buffer.clear();
+        if (sink) {
+            step_buffer.reserve(STEP_BUFFER_SIZE);
         }
-        return tapes[tape_idx].GetContent(from, to);
     }
 
-    int GetHeadPosition(size_t tape_idx) const {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
+    // Отдать приёмнику накопленные номера переходов
+    void FlushSteps() {
+        if (step_sink && !step_buffer.empty()) {
+            step_sink->Consume(step_buffer);
         }
-        return head_positions[tape_idx];
+        step_buffer.clear();
+    }
+
+    bool HasStepSink() const {
+        return step_sink != nullptr;
     }
 
-    std::array<int, MAX_TAPES> GetHeadPositions() const {
-        return head_positions;
+    // Скомпилированные переходы в порядке их номеров
+    virtual Sequence<PatternTransition> GetCompiledTransitions() = 0;
+
+    // Хэш скомпилированной программы: переходы в порядке приоритета, начальное и допускающие
+    // состояния, пустой символ, число лент и программы вложенных машин
+    virtual uint64_t GetProgramHash() = 0;
+
+    std::string GetTapeContent(size_t tape_idx, int64_t from = -10, int64_t to = 10) const {
+        return GetTape(tape_idx)->GetContent(from, to);
     }
 
-    std::string GetCurrentState() const {
-        return current_state;
+    virtual int64_t GetHeadPosition(size_t tape_idx) const = 0;
+
+    // Позиции головок; для лент сверх активных - 0
+    virtual std::array<int64_t, MAX_TAPES> GetHeadPositions() const = 0;
+
+    // Внутри вызова имя состояния предваряется именами вызванных машин: "add:q1"
+    virtual std::string GetCurrentState() const {
+        return state_names[current_state];
     }
 
     size_t GetStepCount() const {
         return step_count;
     }
 
-    bool IsAcceptState() const {
-        return accept_states.count(current_state) > 0;
+    virtual bool IsAcceptState() const {
+        return IsAccepting(current_state);
     }
 
     size_t GetMaterializedCellsCount(size_t tape_idx) const {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
-        }
-        return tapes[tape_idx].GetMaterializedCount();
+        return GetTape(tape_idx)->GetMaterializedCount();
     }
 
     // Получить количество модифицированных ячеек
     size_t GetModifiedCellsCount(size_t tape_idx) const {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
-        }
-        return tapes[tape_idx].GetModifiedCount();
+        return GetTape(tape_idx)->GetModifiedCount();
     }
 
     size_t GetTotalMaterializedCellsCount() const {
         size_t total = 0;
         for (size_t i = 0; i < active_tapes; ++i) {
-            total += tapes[i].GetMaterializedCount();
+            total += GetTape(i)->GetMaterializedCount();
         }
         return total;
     }
@@ -285,7 +580,7 @@ public:
     size_t GetTotalModifiedCellsCount() const {
         size_t total = 0;
         for (size_t i = 0; i < active_tapes; ++i) {
-            total += tapes[i].GetModifiedCount();
+            total += GetTape(i)->GetModifiedCount();
         }
         return total;
     }
@@ -293,11 +588,8 @@ public:
     void Reset(const Sequence<std::string>& new_inputs = Sequence<std::string>()) {
         current_state = start_state;
         step_count = 0;
-
-        for (size_t i = 0; i < MAX_TAPES; ++i) {
-            head_positions[i] = 0;
-            tapes[i].ClearMaterialized();
-        }
+        cycle_period = 0;
+        ClearTapes();
 
         if (!new_inputs.IsEmpty()) {
             InitializeTapes(new_inputs);
@@ -309,17 +601,19 @@ public:
         for (size_t i = 0; i < active_tapes; ++i) {
             ss << "Tape " << (i + 1) << ": ";
 
-            int min_pos = tapes[i].GetMinIndex();
-            int max_pos = tapes[i].GetMaxIndex();
-            int start = std::min({ min_pos, head_positions[i] - window_size });
-            int end = std::max({ max_pos, head_positions[i] + window_size });
+            const BidirectionalLazyTape<char>* tape = GetTape(i);
+            int64_t head = GetHeadPosition(i);
+            int64_t min_pos = tape->GetMinIndex();
+            int64_t max_pos = tape->GetMaxIndex();
+            int64_t start = std::min<int64_t>({ min_pos, head - window_size });
+            int64_t end = std::max<int64_t>({ max_pos, head + window_size });
 
-            for (int j = start; j <= end; ++j) {
-                if (j == head_positions[i]) {
-                    ss << "[" << tapes[i].Get(j) << "]";
+            for (int64_t j = start; j <= end; ++j) {
+                if (j == head) {
+                    ss << "[" << tape->Peek(j) << "]";
                 }
                 else {
-                    ss << tapes[i].Get(j);
+                    ss << tape->Peek(j);
                 }
             }
             ss << "\n";
@@ -328,46 +622,27 @@ public:
     }
 
     void PrintState() const {
-        std::cout << "State: " << current_state << " | Steps: " << step_count << "\n";
+        std::cout << "State: " << GetCurrentState() << " | Steps: " << step_count << "\n";
         std::cout << "Head positions: ";
         for (size_t i = 0; i < active_tapes; ++i) {
-            std::cout << "Tape" << (i + 1) << "=" << head_positions[i];
+            std::cout << "Tape" << (i + 1) << "=" << GetHeadPosition(i);
             if (i < active_tapes - 1) std::cout << ", ";
         }
         std::cout << " | Total materialized cells: " << GetTotalMaterializedCellsCount()
             << " | Modified cells: " << GetTotalModifiedCellsCount() << "\n";
     }
 
-    struct TapeStatistics {
-        size_t tape_index;
-        size_t materialized_cells;
-        size_t modified_cells; 
-        int min_index;
-        int max_index;
-        int current_position;
-
-        std::string ToString() const {
-            std::stringstream ss;
-            ss << "Tape " << (tape_index + 1) << " Statistics:\n"
-                << "  Materialized cells: " << materialized_cells << "\n"
-                << "  Modified cells: " << modified_cells << "\n"
-                << "  Min index: " << min_index << "\n"
-                << "  Max index: " << max_index << "\n"
-                << "  Current position: " << current_position;
-            return ss.str();
-        }
-    };
-
     Sequence<TapeStatistics> GetTapeStatistics() const {
         Sequence<TapeStatistics> stats;
         for (size_t i = 0; i < active_tapes; ++i) {
+            const BidirectionalLazyTape<char>* tape = GetTape(i);
             stats.Append({
                 i,
-                tapes[i].GetMaterializedCount(),
-                tapes[i].GetModifiedCount(),
-                tapes[i].GetMinIndex(),
-                tapes[i].GetMaxIndex(),
-                head_positions[i]
+                tape->GetMaterializedCount(),
+                tape->GetModifiedCount(),
+                tape->GetMinIndex(),
+                tape->GetMaxIndex(),
+                GetHeadPosition(i)
                 });
         }
         return stats;
@@ -378,13 +653,229 @@ public:
     }
 
     char GetSymbolAtHead(size_t tape_idx) const {
-        if (tape_idx >= active_tapes) {
-            throw InvalidTapeException();
+        return GetTape(tape_idx)->Peek(GetHeadPosition(tape_idx));
+    }
+
+    char GetBlankSymbol() const {
+        return blank_symbol;
+    }
+
+    size_t GetMaxSteps() const {
+        return max_steps;
+    }
+
+    // Доступ для внешних механизмов выполнения (NativeProgram)
+    virtual BidirectionalLazyTape<char>* GetMutableTape(size_t tape_idx) = 0;
+
+    virtual void SetHeadPosition(size_t tape_idx, int64_t position) = 0;
+
+    // Состояние основной программы; незавершённые вызовы отбрасываются
+    virtual void SetCurrentState(const std::string& state) {
+        current_state = InternState(state);
+    }
+
+    // Внешние механизмы не ведут журнал, поэтому он начинается заново
+    void AdvanceStepCount(size_t steps) {
+        step_count += steps;
+        ResetJournal();
+    }
+
+protected:
+    enum class StopReason {
+        Accepted,
+        Halted,
+        StepLimit,
+        MaxStepsExceeded,
+        Cycle
+    };
+
+    // Шагов между проверками флага отмены
+    static constexpr size_t CANCEL_CHECK_INTERVAL = size_t(1) << 20;
+    // Номеров переходов, накапливаемых перед передачей приёмнику
+    static constexpr size_t STEP_BUFFER_SIZE = size_t(1) << 16;
+
+    // Вложенная машина и версия её программы, с которой скомпилирована эта программа
+    struct SubMachine {
+        std::shared_ptr<TuringMachine> machine;
+        uint64_t linked_version;
+    };
+
+    std::map<std::pair<std::string, std::array<char, MAX_TAPES>>, Transition> transitions;
+    std::vector<PatternTransition> pattern_transitions;
+    std::map<std::string, SubMachine> sub_machines;
+    uint64_t program_version;  // число компиляций программы
+    std::map<std::string, uint32_t> state_ids;  // интернирование состояний
+    std::vector<std::string> state_names;
+    uint32_t current_state;
+    uint32_t start_state;
+    std::vector<uint64_t> accept_bitmap;
+    char blank_symbol;
+    size_t step_count;
+    size_t max_steps;
+    size_t active_tapes;
+    bool program_dirty;
+    ExecutionEngine engine;
+    bool detect_cycles;
+    size_t cycle_period;  // период последнего найденного зацикливания
+    // Поиск зацикливания по Бренту: сохранённый хэш, длина окна и шаги в нём.
+    // Порции одного Run с cancel и запуски с resume_cycle_search продолжают поиск,
+    // иначе он начинается заново
+    bool cycle_resume;
+    uint64_t cycle_saved;
+    size_t cycle_power;
+    size_t cycle_lambda;
+    bool journaling;
+    JournalOptions journal_options;
+    bool profiling;
+    std::vector<uint64_t> transition_hits;  // параллельно скомпилированным переходам
+    std::vector<uint64_t> state_steps;      // по номерам состояний
+    std::array<int64_t, MAX_TAPES> head_min;
+    std::array<int64_t, MAX_TAPES> head_max;
+    StepSink* step_sink;
+    std::vector<uint32_t> step_buffer;
+
+    TuringMachine(const std::string& start,
+        size_t num_tapes,
+        char blank,
+        size_t max_steps_limit,
+        ExecutionEngine execution_engine)
+        : program_version(0),
+        current_state(0),
+        start_state(0),
+        blank_symbol(blank),
+        step_count(0),
+        max_steps(max_steps_limit),
+        active_tapes(num_tapes),
+        program_dirty(true),
+        engine(execution_engine),
+        detect_cycles(false),
+        cycle_period(0),
+        cycle_resume(false),
+        cycle_saved(0),
+        cycle_power(1),
+        cycle_lambda(0),
+        journaling(false),
+        profiling(false),
+        step_sink(nullptr) {
+        head_min.fill(0);
+        head_max.fill(0);
+        start_state = InternState(start);
+        current_state = start_state;
+    }
+
+    TuringMachine(const TuringMachine&) = default;
+    TuringMachine& operator=(const TuringMachine&) = default;
+
+    // Выполнить не более limit шагов
+    virtual StopReason Execute(size_t limit) = 0;
+
+    // Журнал и снимки становятся недействительны при изменении программы или лент
+    virtual void ResetJournal() = 0;
+
+    // Вернуть головки в 0, очистить ленты и журнал
+    virtual void ClearTapes() = 0;
+
+    static uint64_t MixHash(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // FNV-1a
+    static uint64_t HashText(const std::string& text) {
+        uint64_t hash = 1469598103934665603ull;
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint32_t InternState(const std::string& name) {
+        auto it = state_ids.find(name);
+        if (it != state_ids.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(state_names.size());
+        state_ids.emplace(name, id);
+        state_names.push_back(name);
+        if (accept_bitmap.size() * 64 <= id) {
+            accept_bitmap.push_back(0);
+        }
+        program_dirty = true;
+        return id;
+    }
+
+    bool IsAccepting(uint32_t state) const {
+        return (accept_bitmap[state >> 6] >> (state & 63)) & 1;
+    }
+
+    // Переход может сработать, только если на неактивных лентах он читает пустой символ.
+    // Нулевой символ означает, что лента в переходе не задана (короткий список инициализации)
+    bool IsReachableTransition(const Transition& t) const {
+        for (size_t i = active_tapes; i < MAX_TAPES; ++i) {
+            if (t.read_symbols[i] != blank_symbol && t.read_symbols[i] != 0) return false;
+        }
+        return true;
+    }
+
+    bool IsReachablePattern(const PatternTransition& t) const {
+        for (size_t i = 0; i < MAX_TAPES; ++i) {
+            bool empty = t.read_classes[i].IsEmpty();
+            if (i < active_tapes ? empty : !empty && !t.read_classes[i].Contains(blank_symbol)) return false;
+        }
+        return true;
+    }
+
+    // Программа перекомпилируется и после перекомпиляции любой вложенной машины
+    void EnsureCompiled() {
+        if (program_dirty || (!sub_machines.empty() && SubMachinesChanged())) {
+            Finalize();
+        }
+    }
+
+    bool SubMachinesChanged() {
+        bool changed = false;
+        for (auto& entry : sub_machines) {
+            TuringMachine& sub = *entry.second.machine;
+            sub.EnsureCompiled();
+            changed = changed || sub.program_version != entry.second.linked_version;
+        }
+        return changed;
+    }
+
+    bool UsesSubMachine(const TuringMachine& machine) const {
+        for (const auto& entry : sub_machines) {
+            if (entry.second.machine.get() == &machine || entry.second.machine->UsesSubMachine(machine)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool FinishRun(StopReason reason) const {
+        switch (reason) {
+        case StopReason::Accepted:
+            return true;
+        case StopReason::Halted:
+            return false;
+        case StopReason::Cycle:
+            throw InfiniteLoopException(cycle_period);
+        default:
+            throw std::runtime_error("Maximum steps exceeded");
+        }
+    }
+
+    static RunStatus ToRunStatus(StopReason reason) {
+        switch (reason) {
+        case StopReason::Accepted: return RunStatus::Accepted;
+        case StopReason::Halted: return RunStatus::Halted;
+        case StopReason::Cycle: return RunStatus::Cycle;
+        default: return RunStatus::StepLimit;
         }
-        return tapes[tape_idx].Get(head_positions[tape_idx]);
     }
 
-private:
     std::array<char, MAX_TAPES> GetDefaultReadArray() const {
         std::array<char, MAX_TAPES> arr;
         arr.fill(blank_symbol);
@@ -397,3 +888,1188 @@ private:
         return arr;
     }
 };
+
+// Машина с N лентами. Циклы по лентам разворачиваются при компиляции,
+// массивы имеют ровно N элементов
+template <size_t N>
+class MultiTapeTuringMachine final : public TuringMachine {
+    static_assert(N >= 1 && N <= MAX_TAPES, "Unsupported number of tapes");
+
+private:
+    // Переход после компиляции: состояния заменены плотными номерами
+    struct CompiledTransition {
+        uint32_t state_to;
+        std::array<char, N> write_symbols;
+        std::array<int, N> moves;
+        std::array<int8_t, N> copy_from;  // лента, чей символ записывается, или -1
+        uint8_t copy_mask = 0;            // ленты с копированием
+        int32_t sweep = -1;  // группа петли-пробега, если переход её образует
+        int32_t call = -1;   // вызываемая программа (номер в callees), state_to - состояние возврата
+    };
+
+    // Переход с классами, не раскрытый в хэш-таблицу: проверяется перебором после неё
+    struct SparsePattern {
+        int32_t index;
+        std::array<std::bitset<256>, N> classes;  // номера классов символов по лентам
+    };
+
+    // Группа переходов-петель одного состояния, сдвигающих одну ленту в одну сторону,
+    // не меняя остальные ленты. Пробег по таким ячейкам выполняется одной операцией
+    struct SweepGroup {
+        size_t tape;
+        int direction;
+        std::array<uint8_t, 256> matches;  // символы, на которых петля продолжается
+        std::array<char, 256> rewrite;     // что записывается вместо прочитанного символа
+    };
+
+    enum ThreadedOpcode : uint8_t {
+        OP_ACCEPT,
+        OP_HALT,
+        OP_DISPATCH,
+        OP_DISPATCH_SPARSE,
+        OP_TRANSITION,
+        OP_SWEEP,
+        OP_CALL
+    };
+
+    // Операция потокового кода. Для блока состояния index - номер состояния,
+    // для перехода - номер скомпилированного перехода
+    struct ThreadedOp {
+        uint8_t opcode;
+        uint32_t index;
+    };
+
+    enum FrameChange : uint8_t {
+        FRAME_NONE,
+        FRAME_CALL,
+        FRAME_RETURN
+    };
+
+    // Запись журнала: всё, что нужно для отката одного шага
+    struct JournalEntry {
+        uint32_t previous_state;
+        std::array<char, N> old_symbols;
+        std::array<int32_t, N> moves;  // сдвиг переходом может быть любым int
+        uint8_t modified_mask;  // была ли ячейка модифицирована до записи
+        uint8_t frame_change;   // FrameChange: шаг вызова или возврата
+        uint16_t callee;        // для возврата - номер программы снятого кадра
+    };
+
+    struct CompiledProgram;
+
+    // Кадр вызова вложенной машины
+    struct CallFrame {
+        std::shared_ptr<const CompiledProgram> program;  // программа вызванной машины
+        uint32_t return_state;  // состояние вызывающей программы после возврата
+        uint16_t callee;        // номер программы в callees вызывающей
+    };
+
+    // Полный снимок конфигурации
+    struct Checkpoint {
+        size_t step;
+        uint32_t state;
+        std::array<int64_t, N> heads;
+        std::array<BidirectionalLazyTape<char>, N> tapes;
+        std::vector<CallFrame> calls;
+    };
+
+    // Скомпилированная программа: плоская таблица, индексируемая (состояние, кортеж классов).
+    // Символы каждой ленты заменены номерами классов эквивалентности: символы одного класса
+    // не различает ни один переход. Если таблица слишком велика, кортеж упаковывается
+    // в 64-битный ключ (по байту на ленту)
+    struct CompiledProgram {
+        std::array<std::array<uint16_t, 256>, N> symbol_index;
+        std::array<size_t, N> alphabet_sizes;
+        size_t tuple_count = 1;  // число кортежей символов на одно состояние
+        std::vector<CompiledTransition> transitions;
+        std::vector<PatternTransition> sources;  // исходные переходы для отчётов, параллельно transitions
+        std::vector<SweepGroup> sweeps;
+        std::vector<int32_t> dense_table;  // state * tuple_count + tuple -> номер перехода или -1
+        std::vector<std::unordered_map<uint64_t, int32_t>> sparse_rows;  // по состояниям: ключ классов -> переход
+        std::vector<std::vector<SparsePattern>> pattern_rows;  // по состояниям, после sparse_rows
+        std::vector<uint64_t> halt_bitmap;  // состояния без исходящих переходов
+        std::vector<ThreadedOp> threaded_code;  // блоки состояний [0, states), затем переходы
+        // Программа выполняется и как вызванная, поэтому хранит свои состояния
+        std::vector<std::string> state_names;
+        std::vector<uint64_t> accept_bitmap;
+        uint32_t start_state = 0;
+        std::vector<std::shared_ptr<const CompiledProgram>> callees;  // программы вложенных машин
+        std::vector<std::string> callee_names;
+        uint64_t hash = 0;
+    };
+
+    // Предел размера плотной таблицы (в элементах), дальше используется хэш-таблица
+    static constexpr size_t DENSE_TABLE_LIMIT = size_t(1) << 22;
+    // Сколько кортежей классов один переход может занять в хэш-таблице
+    static constexpr size_t SPARSE_EXPANSION_LIMIT = size_t(1) << 12;
+
+    std::array<int64_t, N> head_positions;
+    std::array<BidirectionalLazyTape<char>, N> tapes;
+    std::shared_ptr<const CompiledProgram> program;  // неизменяема, разделяется копиями машины
+    std::deque<JournalEntry> journal;  // откат шагов (step_count - size, step_count]
+    std::deque<Checkpoint> checkpoints;
+    std::vector<CallFrame> call_stack;  // пусто - выполняется program
+
+    struct ForkTag {};
+
+    // Копия без журнала, снимков и приёмника шагов
+    MultiTapeTuringMachine(const MultiTapeTuringMachine& other, ForkTag)
+        : TuringMachine(other),
+        head_positions(other.head_positions),
+        tapes(other.tapes),
+        program(other.program),
+        call_stack(other.call_stack) {
+        step_sink = nullptr;
+        step_buffer.clear();
+        ResetJournal();
+    }
+
+public:
+    explicit MultiTapeTuringMachine(const std::string& start,
+        char blank = ' ',
+        size_t max_steps_limit = 1000000,
+        ExecutionEngine execution_engine = ExecutionEngine::Interpreter)
+        : TuringMachine(start, N, blank, max_steps_limit, execution_engine) {
+        for (size_t i = 0; i < N; ++i) {
+            tapes[i] = BidirectionalLazyTape<char>(blank);
+            head_positions[i] = 0;
+        }
+    }
+
+    std::unique_ptr<TuringMachine> Clone() const override {
+        return std::make_unique<MultiTapeTuringMachine>(*this);
+    }
+
+    std::unique_ptr<TuringMachine> Fork() const override {
+        return std::unique_ptr<TuringMachine>(new MultiTapeTuringMachine(*this, ForkTag()));
+    }
+
+    const BidirectionalLazyTape<char>* GetTape(size_t i) const override {
+        if (i >= N) throw InvalidTapeException();
+        return &tapes[i];
+    }
+
+    void Finalize() override {
+        CompiledProgram compiled;
+
+        // Вложенные машины компилируются сами, программа ссылается на их готовые программы
+        std::map<std::string, int32_t> callee_ids;
+        for (auto& entry : sub_machines) {
+            auto* callee = dynamic_cast<MultiTapeTuringMachine*>(entry.second.machine.get());
+            if (!callee) {
+                throw InvalidTapeException("Sub-machine must have the same number of tapes");
+            }
+            callee->EnsureCompiled();
+            entry.second.linked_version = callee->program_version;
+            callee_ids[entry.first] = static_cast<int32_t>(compiled.callees.size());
+            compiled.callees.push_back(callee->program);
+            compiled.callee_names.push_back(entry.first);
+        }
+
+        // Обычные переходы раньше переходов с классами: при пересечении побеждает первый
+        std::vector<PatternTransition> rules;
+        for (const auto& entry : transitions) {
+            if (IsReachableTransition(entry.second)) rules.emplace_back(entry.second);
+        }
+        for (const PatternTransition& t : pattern_transitions) {
+            if (IsReachablePattern(t)) rules.push_back(t);
+        }
+
+        std::array<SymbolPartition, N> partitions;
+        for (const PatternTransition& t : rules) {
+            for (size_t i = 0; i < N; ++i) {
+                partitions[i].Refine(t.read_classes[i]);
+            }
+        }
+
+        size_t state_count = state_names.size();
+        bool dense = true;
+        for (size_t i = 0; i < N; ++i) {
+            compiled.symbol_index[i] = partitions[i].GetTable();
+            size_t next = partitions[i].GetCount();
+            compiled.alphabet_sizes[i] = next;
+            // Произведение алфавитов восьми лент может переполниться - останавливаемся на пределе
+            if (compiled.tuple_count > DENSE_TABLE_LIMIT / next) {
+                dense = false;
+            }
+            else {
+                compiled.tuple_count *= next;
+            }
+        }
+
+        dense = dense && state_count * compiled.tuple_count <= DENSE_TABLE_LIMIT;
+        if (dense) {
+            compiled.dense_table.assign(state_count * compiled.tuple_count, -1);
+        }
+        else {
+            compiled.sparse_rows.resize(state_count);
+            compiled.pattern_rows.resize(state_count);
+        }
+        compiled.halt_bitmap.assign((state_count + 63) / 64, ~uint64_t(0));
+
+        for (const PatternTransition& t : rules) {
+            uint32_t from = state_ids.at(t.state_from);
+            CompiledTransition ct;
+            ct.state_to = state_ids.at(t.state_to);
+            std::copy_n(t.write_symbols.begin(), N, ct.write_symbols.begin());
+            std::copy_n(t.moves.begin(), N, ct.moves.begin());
+            for (size_t i = 0; i < N; ++i) {
+                ct.copy_from[i] = static_cast<int8_t>(t.copy_from[i]);
+                if (t.copy_from[i] >= 0) ct.copy_mask |= static_cast<uint8_t>(1u << i);
+            }
+            if (!t.call.empty()) {
+                auto callee = callee_ids.find(t.call);
+                if (callee == callee_ids.end()) {
+                    throw InvalidStateException("Unknown sub-machine: " + t.call);
+                }
+                ct.call = callee->second;
+            }
+
+            int32_t index = static_cast<int32_t>(compiled.transitions.size());
+            compiled.transitions.push_back(ct);
+            compiled.sources.push_back(t);
+
+            std::array<std::vector<uint16_t>, N> members;
+            size_t expansion = 1;
+            for (size_t i = 0; i < N; ++i) {
+                members[i] = partitions[i].ClassesIn(t.read_classes[i]);
+                expansion = std::min(expansion * members[i].size(), SPARSE_EXPANSION_LIMIT + 1);
+            }
+
+            if (dense) {
+                ForEachTuple(members, [&](const std::array<uint16_t, N>& classes) {
+                    int32_t& slot = compiled.dense_table[from * compiled.tuple_count + TupleIndex(compiled, classes)];
+                    if (slot < 0) slot = index;
+                });
+            }
+            else if (compiled.pattern_rows[from].empty() && expansion <= SPARSE_EXPANSION_LIMIT) {
+                ForEachTuple(members, [&](const std::array<uint16_t, N>& classes) {
+                    compiled.sparse_rows[from].emplace(PackClasses(classes), index);
+                });
+            }
+            else {
+                // После первого нераскрытого перехода все следующие переходы состояния
+                // тоже идут в перебор, чтобы сохранить порядок приоритета
+                SparsePattern pattern;
+                pattern.index = index;
+                for (size_t i = 0; i < N; ++i) {
+                    for (uint16_t c : members[i]) pattern.classes[i].set(c);
+                }
+                compiled.pattern_rows[from].push_back(pattern);
+            }
+            compiled.halt_bitmap[from >> 6] &= ~(uint64_t(1) << (from & 63));
+        }
+
+        compiled.state_names = state_names;
+        compiled.accept_bitmap = accept_bitmap;
+        compiled.start_state = start_state;
+        compiled.hash = HashProgram(compiled);
+
+        DetectSweeps(compiled);
+
+        // Потоковый код нужен всегда: программу может вызвать машина с любым механизмом
+        BuildThreadedCode(compiled);
+
+        program = std::make_shared<const CompiledProgram>(std::move(compiled));
+        program_dirty = false;
+        program_version++;
+        if (profiling) {
+            ResetProfile();
+        }
+    }
+
+    void InitializeTape(size_t tape_idx, const std::string& input) override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        head_positions[tape_idx] = 0;
+        tapes[tape_idx].Initialize(input);
+        ResetJournal();
+    }
+
+    void InitializeTape(size_t tape_idx, std::shared_ptr<TapeInput> input) override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        head_positions[tape_idx] = 0;
+        tapes[tape_idx].Initialize(std::move(input));
+        ResetJournal();
+    }
+
+    void SetTapeStorage(size_t tape_idx, TapeStorage storage) override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        tapes[tape_idx].SetStorage(storage);
+        ResetJournal();
+    }
+
+    TapeStorage GetTapeStorage(size_t tape_idx) const override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        return tapes[tape_idx].GetStorage();
+    }
+
+    bool ExecuteStep() override {
+        if (step_count >= max_steps) {
+            throw std::runtime_error("Maximum steps exceeded");
+        }
+        EnsureCompiled();
+
+        if (IsReturning()) {
+            ApplyRecordedReturn();
+            return true;
+        }
+        int32_t index = FindTransition();
+        if (index < 0) {
+            return false;
+        }
+
+        if (profiling && call_stack.empty()) CountStep(index);
+        if (step_sink) RecordStep(index);
+        ApplyRecordedTransition(Running().transitions[index]);
+        if (profiling) TrackHeads();
+        return true;
+    }
+
+    bool CanStep() override {
+        if (step_count >= max_steps) {
+            return false;
+        }
+        EnsureCompiled();
+        return IsReturning() || FindTransition() >= 0;
+    }
+
+    size_t GetEarliestReachableStep() const override {
+        size_t earliest = step_count - journal.size();
+        if (!checkpoints.empty()) {
+            earliest = std::min(earliest, checkpoints.front().step);
+        }
+        return earliest;
+    }
+
+    bool SeekToStep(size_t n) override {
+        if (n >= step_count) {
+            while (step_count < n) {
+                if (!ExecuteStep()) return false;
+            }
+            return true;
+        }
+        if (!journaling) {
+            throw InvalidArgumentException("Journal is disabled");
+        }
+
+        if (step_count - n <= journal.size()) {
+            while (step_count > n) {
+                UndoStep();
+            }
+            return true;
+        }
+
+        auto it = checkpoints.end();
+        while (it != checkpoints.begin() && std::prev(it)->step > n) {
+            --it;
+        }
+        if (it == checkpoints.begin()) {
+            throw InvalidArgumentException("Step " + std::to_string(n) + " is no longer available in the journal");
+        }
+
+        const Checkpoint& checkpoint = *std::prev(it);
+        current_state = checkpoint.state;
+        head_positions = checkpoint.heads;
+        tapes = checkpoint.tapes;
+        call_stack = checkpoint.calls;
+        step_count = checkpoint.step;
+        journal.clear();
+
+        while (step_count < n) {
+            if (!ExecuteStep()) return false;
+        }
+        return true;
+    }
+
+    void EnableCycleDetection(bool enabled) override {
+        detect_cycles = enabled;
+        for (size_t i = 0; i < N; ++i) {
+            tapes[i].EnableContentHash(enabled);
+        }
+    }
+
+    uint64_t GetConfigurationHash() const override {
+        uint64_t hash = MixHash(current_state + 0x51ed270b27e5c3a1ull);
+        for (size_t i = 0; i < N; ++i) {
+            hash = MixHash(hash ^ tapes[i].GetContentHash());
+            hash = MixHash(hash ^ static_cast<uint64_t>(head_positions[i]));
+        }
+        for (const CallFrame& frame : call_stack) {
+            hash = MixHash(hash ^ (uint64_t(frame.return_state) << 16 | frame.callee));
+        }
+        return hash;
+    }
+
+    size_t GetCallDepth() const override {
+        return call_stack.size();
+    }
+
+    std::string GetCurrentState() const override {
+        if (call_stack.empty()) {
+            return state_names[current_state];
+        }
+        std::string name;
+        const CompiledProgram* caller = program.get();
+        for (const CallFrame& frame : call_stack) {
+            name += caller->callee_names[frame.callee] + ":";
+            caller = frame.program.get();
+        }
+        return name + caller->state_names[current_state];
+    }
+
+    // Допускающее состояние вызванной машины - это возврат, а не допуск
+    bool IsAcceptState() const override {
+        return call_stack.empty() && IsAccepting(current_state);
+    }
+
+    void SetCurrentState(const std::string& state) override {
+        call_stack.clear();
+        TuringMachine::SetCurrentState(state);
+    }
+
+    uint64_t GetProgramHash() override {
+        EnsureCompiled();
+        return program->hash;
+    }
+
+    Sequence<PatternTransition> GetCompiledTransitions() override {
+        EnsureCompiled();
+        Sequence<PatternTransition> result;
+        for (const PatternTransition& t : program->sources) {
+            result.Append(t);
+        }
+        return result;
+    }
+
+    void ResetProfile() override {
+        transition_hits.assign(program && !program_dirty ? program->transitions.size() : 0, 0);
+        state_steps.assign(state_names.size(), 0);
+        head_min.fill(0);
+        head_max.fill(0);
+        std::copy(head_positions.begin(), head_positions.end(), head_min.begin());
+        std::copy(head_positions.begin(), head_positions.end(), head_max.begin());
+    }
+
+    MachineProfile GetProfile() const override {
+        MachineProfile profile;
+        if (program && transition_hits.size() == program->transitions.size()) {
+            for (size_t i = 0; i < transition_hits.size(); ++i) {
+                const PatternTransition& t = program->sources[i];
+                std::string moves;
+                for (size_t k = 0; k < N; ++k) {
+                    moves += t.moves[k] < 0 ? 'L' : t.moves[k] > 0 ? 'R' : 'S';
+                }
+                profile.transitions.Append({ t.state_from, t.ReadText(N), t.state_to,
+                    t.WriteText(N), moves, transition_hits[i] });
+            }
+        }
+        for (size_t s = 0; s < state_steps.size(); ++s) {
+            profile.states.Append({ state_names[s], state_steps[s] });
+            profile.total_steps += state_steps[s];
+        }
+        for (size_t i = 0; i < N; ++i) {
+            profile.tapes.Append({ i, head_min[i], head_max[i] });
+        }
+        return profile;
+    }
+
+    int64_t GetHeadPosition(size_t tape_idx) const override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        return head_positions[tape_idx];
+    }
+
+    std::array<int64_t, MAX_TAPES> GetHeadPositions() const override {
+        std::array<int64_t, MAX_TAPES> positions = {};
+        std::copy(head_positions.begin(), head_positions.end(), positions.begin());
+        return positions;
+    }
+
+    BidirectionalLazyTape<char>* GetMutableTape(size_t tape_idx) override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        return &tapes[tape_idx];
+    }
+
+    void SetHeadPosition(size_t tape_idx, int64_t position) override {
+        if (tape_idx >= N) {
+            throw InvalidTapeException();
+        }
+        head_positions[tape_idx] = position;
+    }
+
+protected:
+    StopReason Execute(size_t limit) override {
+        if (detect_cycles || journaling || profiling || step_sink) {
+            StopReason reason = RunLoopInstrumented(limit);
+            FlushSteps();
+            return reason;
+        }
+        return engine == ExecutionEngine::Threaded ? RunThreaded(limit) : RunLoop(limit);
+    }
+
+    void ResetJournal() override {
+        journal.clear();
+        checkpoints.clear();
+        if (journaling) {
+            TakeCheckpoint();
+        }
+    }
+
+    void ClearTapes() override {
+        for (size_t i = 0; i < N; ++i) {
+            head_positions[i] = 0;
+            tapes[i].ClearMaterialized();
+        }
+        call_stack.clear();
+        ResetJournal();
+    }
+
+private:
+    // Цикл по лентам, развёрнутый во время компиляции
+    template <typename F>
+    static void ForEachTape(F&& f) {
+        ForEachTape(f, std::make_index_sequence<N>());
+    }
+
+    template <typename F, size_t... I>
+    static void ForEachTape(F& f, std::index_sequence<I...>) {
+        (f(I), ...);
+    }
+
+    static size_t TupleIndex(const CompiledProgram& p, const std::array<uint16_t, N>& classes) {
+        size_t index = 0;
+        ForEachTape([&](size_t i) {
+            index = index * p.alphabet_sizes[i] + classes[i];
+        });
+        return index;
+    }
+
+    // Кортеж классов одним числом: байт i - класс символа ленты i
+    static uint64_t PackClasses(const std::array<uint16_t, N>& classes) {
+        uint64_t key = 0;
+        ForEachTape([&](size_t i) {
+            key |= uint64_t(classes[i]) << (8 * i);
+        });
+        return key;
+    }
+
+    // Перебор всех кортежей из классов members[0] x ... x members[N - 1]
+    template <typename F>
+    static void ForEachTuple(const std::array<std::vector<uint16_t>, N>& members, F f) {
+        for (size_t i = 0; i < N; ++i) {
+            if (members[i].empty()) return;
+        }
+        std::array<size_t, N> position = {};
+        std::array<uint16_t, N> classes;
+        while (true) {
+            for (size_t i = 0; i < N; ++i) {
+                classes[i] = members[i][position[i]];
+            }
+            f(classes);
+            size_t i = 0;
+            while (i < N && ++position[i] == members[i].size()) {
+                position[i++] = 0;
+            }
+            if (i == N) return;
+        }
+    }
+
+    // Переход по кортежу классов
+    static int32_t ResolveClasses(const CompiledProgram& p, uint32_t state, const std::array<uint16_t, N>& classes) {
+        if (!p.dense_table.empty()) {
+            return p.dense_table[state * p.tuple_count + TupleIndex(p, classes)];
+        }
+
+        const auto& row = p.sparse_rows[state];
+        auto it = row.find(PackClasses(classes));
+        if (it != row.end()) {
+            return it->second;
+        }
+        for (const SparsePattern& pattern : p.pattern_rows[state]) {
+            bool matches = true;
+            ForEachTape([&](size_t i) {
+                matches = matches && pattern.classes[i].test(classes[i]);
+            });
+            if (matches) return pattern.index;
+        }
+        return -1;
+    }
+
+    int32_t LookupTransition(const CompiledProgram& p, uint32_t state) const {
+        if (!p.dense_table.empty()) {
+            size_t tuple = 0;
+            ForEachTape([&](size_t i) {
+                unsigned char c = static_cast<unsigned char>(tapes[i].Peek(head_positions[i]));
+                tuple = tuple * p.alphabet_sizes[i] + p.symbol_index[i][c];
+            });
+            return p.dense_table[state * p.tuple_count + tuple];
+        }
+
+        std::array<uint16_t, N> classes;
+        ForEachTape([&](size_t i) {
+            classes[i] = p.symbol_index[i][static_cast<unsigned char>(tapes[i].Peek(head_positions[i]))];
+        });
+        return ResolveClasses(p, state, classes);
+    }
+
+    // Выполняемая программа: своя или программа последнего вызова
+    const CompiledProgram& Running() const {
+        return call_stack.empty() ? *program : *call_stack.back().program;
+    }
+
+    static bool IsAcceptingIn(const CompiledProgram& p, uint32_t state) {
+        return (p.accept_bitmap[state >> 6] >> (state & 63)) & 1;
+    }
+
+    // Вызванная машина пришла в допускающее состояние: следующий шаг - возврат
+    bool IsReturning() const {
+        return !call_stack.empty() && IsAcceptingIn(*call_stack.back().program, current_state);
+    }
+
+    int32_t FindTransition() const {
+        return FindTransition(Running());
+    }
+
+    int32_t FindTransition(const CompiledProgram& p) const {
+        if ((p.halt_bitmap[current_state >> 6] >> (current_state & 63)) & 1) {
+            return -1;
+        }
+        return LookupTransition(p, current_state);
+    }
+
+    void CountStep(int32_t index) {
+        transition_hits[index]++;
+        state_steps[current_state]++;
+    }
+
+    void RecordStep(int32_t index) {
+        step_buffer.push_back(static_cast<uint32_t>(index));
+        if (step_buffer.size() >= STEP_BUFFER_SIZE) {
+            FlushSteps();
+        }
+    }
+
+    void TrackHeads() {
+        ForEachTape([&](size_t i) {
+            head_min[i] = std::min(head_min[i], head_positions[i]);
+            head_max[i] = std::max(head_max[i], head_positions[i]);
+        });
+    }
+
+    // Запись и сдвиг головок; копируемые символы читаются до любой записи
+    void WriteAndMove(const CompiledTransition& t) {
+        if (t.copy_mask) {
+            std::array<char, N> written = t.write_symbols;
+            ForEachTape([&](size_t i) {
+                if (t.copy_from[i] >= 0) {
+                    written[i] = tapes[t.copy_from[i]].Peek(head_positions[t.copy_from[i]]);
+                }
+            });
+            ForEachTape([&](size_t i) {
+                tapes[i].Set(head_positions[i], written[i]);
+                head_positions[i] += t.moves[i];
+            });
+            return;
+        }
+        ForEachTape([&](size_t i) {
+            tapes[i].Set(head_positions[i], t.write_symbols[i]);
+            head_positions[i] += t.moves[i];
+        });
+    }
+
+    // Вызов: запись и сдвиг как у обычного перехода, затем начальное состояние вызванной машины
+    void PushCall(const CompiledProgram& p, const CompiledTransition& t) {
+        WriteAndMove(t);
+        const std::shared_ptr<const CompiledProgram>& callee = p.callees[t.call];
+        call_stack.push_back({ callee, t.state_to, static_cast<uint16_t>(t.call) });
+        current_state = callee->start_state;
+    }
+
+    void PopCall() {
+        current_state = call_stack.back().return_state;
+        call_stack.pop_back();
+    }
+
+    void ApplyTransition(const CompiledTransition& t) {
+        if (t.call >= 0) {
+            PushCall(Running(), t);
+        }
+        else {
+            WriteAndMove(t);
+            current_state = t.state_to;
+        }
+        step_count++;
+    }
+
+    void ApplyRecordedTransition(const CompiledTransition& t) {
+        if (!journaling) {
+            ApplyTransition(t);
+            return;
+        }
+        std::array<int32_t, N> moves;
+        for (size_t i = 0; i < N; ++i) {
+            moves[i] = static_cast<int32_t>(t.moves[i]);
+        }
+        RecordJournalEntry(moves, t.call >= 0 ? FRAME_CALL : FRAME_NONE, 0);
+        ApplyTransition(t);
+        CheckpointIfDue();
+    }
+
+    // Возврат из вызова: ленты не меняются
+    void ApplyRecordedReturn() {
+        if (journaling) {
+            RecordJournalEntry(std::array<int32_t, N>{}, FRAME_RETURN, call_stack.back().callee);
+        }
+        PopCall();
+        step_count++;
+        if (journaling) {
+            CheckpointIfDue();
+        }
+    }
+
+    void RecordJournalEntry(const std::array<int32_t, N>& moves, uint8_t frame_change, uint16_t callee) {
+        JournalEntry entry;
+        entry.previous_state = current_state;
+        entry.modified_mask = 0;
+        entry.moves = moves;
+        entry.frame_change = frame_change;
+        entry.callee = callee;
+        for (size_t i = 0; i < N; ++i) {
+            entry.old_symbols[i] = tapes[i].Peek(head_positions[i]);
+            if (tapes[i].IsModified(head_positions[i])) {
+                entry.modified_mask |= static_cast<uint8_t>(1u << i);
+            }
+        }
+        journal.push_back(entry);
+        if (journal.size() > journal_options.max_entries) {
+            journal.pop_front();
+        }
+    }
+
+    void CheckpointIfDue() {
+        if (journal_options.checkpoint_interval > 0 &&
+            step_count % journal_options.checkpoint_interval == 0) {
+            TakeCheckpoint();
+        }
+    }
+
+    void UndoStep() {
+        const JournalEntry& entry = journal.back();
+        for (size_t i = N; i-- > 0;) {
+            head_positions[i] -= entry.moves[i];
+            tapes[i].Restore(head_positions[i], entry.old_symbols[i], (entry.modified_mask >> i) & 1);
+        }
+        if (entry.frame_change == FRAME_CALL) {
+            call_stack.pop_back();
+        }
+        else if (entry.frame_change == FRAME_RETURN) {
+            // Состояние после возврата - это состояние возврата снятого кадра
+            call_stack.push_back({ Running().callees[entry.callee], current_state, entry.callee });
+        }
+        current_state = entry.previous_state;
+        step_count--;
+        journal.pop_back();
+    }
+
+    void TakeCheckpoint() {
+        if (!checkpoints.empty() && checkpoints.back().step >= step_count) {
+            return;
+        }
+        checkpoints.push_back({ step_count, current_state, head_positions, tapes, call_stack });
+        if (checkpoints.size() > std::max<size_t>(1, journal_options.max_checkpoints)) {
+            checkpoints.pop_front();
+        }
+    }
+
+    // Основной цикл выполнения без исключений
+    StopReason RunLoop(size_t limit) {
+        EnsureCompiled();
+        const CompiledProgram* p = &Running();
+        size_t local_step_count = 0;
+        while (true) {
+            if (local_step_count >= limit) {
+                return StopReason::StepLimit;
+            }
+            if (IsAcceptingIn(*p, current_state)) {
+                if (call_stack.empty()) {
+                    return StopReason::Accepted;
+                }
+                if (step_count >= max_steps) {
+                    return StopReason::MaxStepsExceeded;
+                }
+                PopCall();
+                step_count++;
+                local_step_count++;
+                p = &Running();
+                continue;
+            }
+            if (step_count >= max_steps) {
+                return StopReason::MaxStepsExceeded;
+            }
+            int32_t index = FindTransition(*p);
+            if (index < 0) {
+                return StopReason::Halted;
+            }
+
+            const CompiledTransition& t = p->transitions[index];
+            // У обычного перехода sweep и call равны -1: оба особых случая - одной проверкой
+            if ((t.sweep & t.call) >= 0) {
+                if (t.sweep >= 0) {
+                    size_t budget = std::min(limit - local_step_count, max_steps - step_count);
+                    local_step_count += Sweep(p->sweeps[t.sweep], budget);
+                    continue;
+                }
+                PushCall(*p, t);
+                step_count++;
+                local_step_count++;
+                p = &Running();
+                continue;
+            }
+            WriteAndMove(t);
+            current_state = t.state_to;
+            step_count++;
+            local_step_count++;
+        }
+    }
+
+    // Состояния входят в хэш по именам, поэтому порядок их появления в программе не важен
+    uint64_t HashProgram(const CompiledProgram& p) const {
+        uint64_t hash = MixHash(N << 8 | static_cast<unsigned char>(blank_symbol));
+        auto mix = [&](uint64_t value) {
+            hash = MixHash(hash ^ value);
+        };
+        mix(HashText(state_names[start_state]));
+        for (const auto& entry : state_ids) {
+            if (IsAccepting(entry.second)) mix(HashText(entry.first));
+        }
+        for (const PatternTransition& t : p.sources) {
+            mix(HashText(t.state_from));
+            mix(HashText(t.state_to));
+            mix(HashText(t.call));
+            for (size_t i = 0; i < N; ++i) {
+                mix(HashText(t.read_classes[i].GetText()));
+                mix(static_cast<unsigned char>(t.write_symbols[i]) | uint64_t(t.copy_from[i] + 1) << 8 | uint64_t(t.moves[i] + 1) << 16);
+            }
+        }
+        for (size_t k = 0; k < p.callees.size(); ++k) {
+            mix(HashText(p.callee_names[k]));
+            mix(p.callees[k]->hash);
+        }
+        return hash;
+    }
+
+    // Поиск петель-пробегов: переход в то же состояние, двигается ровно одна лента,
+    // остальные ленты стоят и перезаписывают прочитанный символ им же. Группа собирается
+    // по таблице: для каждого символа движущейся ленты при тех же классах остальных лент
+    void DetectSweeps(CompiledProgram& p) const {
+        std::map<std::vector<uint32_t>, int32_t> groups;
+        std::vector<std::vector<uint32_t>> keys(p.transitions.size());
+
+        for (size_t index = 0; index < p.transitions.size(); ++index) {
+            const CompiledTransition& t = p.transitions[index];
+            const PatternTransition& source = p.sources[index];
+            uint32_t state = state_ids.at(source.state_from);
+            if (t.state_to != state || t.call >= 0) continue;
+
+            size_t moving = N;
+            bool others_unchanged = true;
+            for (size_t i = 0; i < N; ++i) {
+                if (t.moves[i] != 0) {
+                    if (moving != N) others_unchanged = false;
+                    moving = i;
+                }
+            }
+            if (moving == N || (t.copy_from[moving] >= 0 && t.copy_from[moving] != static_cast<int>(moving))) continue;
+
+            // Ключ группы: состояние, движущаяся лента, направление и классы остальных лент
+            std::vector<uint32_t> key = { state, static_cast<uint32_t>(moving), static_cast<uint32_t>(t.moves[moving] + 1) };
+            for (size_t i = 0; i < N && others_unchanged; ++i) {
+                if (i == moving) continue;
+                const SymbolClass& read = source.read_classes[i];
+                bool copies_itself = t.copy_from[i] == static_cast<int>(i);
+                bool rewrites_same = t.copy_from[i] < 0 && read.IsSingle() && read.Contains(t.write_symbols[i]);
+                // Класс остальной ленты должен совпадать ровно с одним классом эквивалентности
+                uint16_t first = 0;
+                size_t found = 0;
+                for (unsigned c = 0; c < 256; ++c) {
+                    if (!read.GetSymbols().test(c)) continue;
+                    if (found == 0 || p.symbol_index[i][c] != first) {
+                        first = p.symbol_index[i][c];
+                        found++;
+                    }
+                }
+                others_unchanged = (copies_itself || rewrites_same) && found == 1;
+                key.push_back(first);
+            }
+            if (!others_unchanged) continue;
+
+            keys[index] = key;
+            if (groups.emplace(key, static_cast<int32_t>(p.sweeps.size())).second) {
+                SweepGroup group;
+                group.tape = moving;
+                group.direction = t.moves[moving];
+                group.matches.fill(0);
+                group.rewrite.fill(0);
+                p.sweeps.push_back(group);
+            }
+        }
+
+        for (const auto& entry : groups) {
+            const std::vector<uint32_t>& key = entry.first;
+            SweepGroup& group = p.sweeps[entry.second];
+            std::array<uint16_t, N> classes = {};
+            for (size_t i = 0, k = 3; i < N; ++i) {
+                if (i != group.tape) classes[i] = static_cast<uint16_t>(key[k++]);
+            }
+            for (unsigned c = 0; c < 256; ++c) {
+                classes[group.tape] = p.symbol_index[group.tape][c];
+                int32_t index = ResolveClasses(p, key[0], classes);
+                if (index < 0 || keys[index] != key) continue;
+                CompiledTransition& t = p.transitions[index];
+                group.matches[c] = 1;
+                group.rewrite[c] = t.copy_from[group.tape] >= 0 ? static_cast<char>(c) : t.write_symbols[group.tape];
+                t.sweep = entry.second;
+            }
+        }
+    }
+
+    // Пробег петли целиком: не больше budget шагов, счётчик шагов обновляется точно
+    size_t Sweep(const SweepGroup& group, size_t budget) {
+        size_t count = SweepTapes(group, budget);
+        step_count += count;
+        return count;
+    }
+
+    size_t SweepTapes(const SweepGroup& group, size_t budget) {
+        size_t count = tapes[group.tape].Sweep(head_positions[group.tape], group.direction,
+            group.matches.data(), group.rewrite.data(), budget);
+        // Неподвижные ленты перезаписывают свой символ тем же значением
+        if (count > 0) {
+            ForEachTape([&](size_t i) {
+                if (i != group.tape) {
+                    tapes[i].Set(head_positions[i], tapes[i].Peek(head_positions[i]));
+                }
+            });
+        }
+        return count;
+    }
+
+    // Цикл с журналом и поиском зацикливания (алгоритм Брента: хэш сравнивается с сохранённым,
+    // который обновляется через степени двойки). Пробеги не ускоряются
+    StopReason RunLoopInstrumented(size_t limit) {
+        EnsureCompiled();
+        if (!cycle_resume) {
+            cycle_saved = GetConfigurationHash();
+            cycle_power = 1;
+            cycle_lambda = 0;
+        }
+
+        for (size_t local_step_count = 0;; ++local_step_count) {
+            if (local_step_count >= limit) {
+                return StopReason::StepLimit;
+            }
+            const CompiledProgram& p = Running();
+            bool accepting = IsAcceptingIn(p, current_state);
+            if (accepting && call_stack.empty()) {
+                return StopReason::Accepted;
+            }
+            if (step_count >= max_steps) {
+                return StopReason::MaxStepsExceeded;
+            }
+            if (accepting) {
+                ApplyRecordedReturn();
+            }
+            else {
+                int32_t index = FindTransition(p);
+                if (index < 0) {
+                    return StopReason::Halted;
+                }
+                // Профиль описывает переходы своей программы, шаги вложенных машин в него не входят
+                if (profiling && call_stack.empty()) CountStep(index);
+                if (step_sink) RecordStep(index);
+                ApplyRecordedTransition(p.transitions[index]);
+            }
+            if (profiling) TrackHeads();
+            if (!detect_cycles) continue;
+
+            uint64_t hash = GetConfigurationHash();
+            ++cycle_lambda;
+            if (hash == cycle_saved) {
+                cycle_period = cycle_lambda;
+                return StopReason::Cycle;
+            }
+            if (cycle_lambda == cycle_power) {
+                cycle_saved = hash;
+                cycle_power *= 2;
+                cycle_lambda = 0;
+            }
+        }
+    }
+
+    // Понижение таблицы переходов в потоковый код
+    void BuildThreadedCode(CompiledProgram& p) const {
+        size_t state_count = state_names.size();
+        p.threaded_code.resize(state_count + p.transitions.size());
+
+        for (uint32_t s = 0; s < state_count; ++s) {
+            ThreadedOp& op = p.threaded_code[s];
+            op.index = s;
+            if (IsAccepting(s)) {
+                op.opcode = OP_ACCEPT;
+            }
+            else if ((p.halt_bitmap[s >> 6] >> (s & 63)) & 1) {
+                op.opcode = OP_HALT;
+            }
+            else {
+                op.opcode = p.dense_table.empty() ? OP_DISPATCH_SPARSE : OP_DISPATCH;
+            }
+        }
+
+        for (size_t t = 0; t < p.transitions.size(); ++t) {
+            ThreadedOp& op = p.threaded_code[state_count + t];
+            op.opcode = p.transitions[t].sweep >= 0 ? OP_SWEEP : p.transitions[t].call >= 0 ? OP_CALL : OP_TRANSITION;
+            op.index = static_cast<uint32_t>(t);
+        }
+    }
+
+    // Исполнение потокового кода: каждая операция сама передаёт управление следующей.
+    // Порядок проверок совпадает с RunLoop. Вызов и возврат переключают программу
+    StopReason RunThreaded(size_t limit) {
+        EnsureCompiled();
+        const CompiledProgram* p = &Running();
+        const ThreadedOp* code = p->threaded_code.data();
+        size_t state_count = p->state_names.size();
+        const size_t budget = std::min(limit, max_steps - step_count);
+        size_t done = 0;
+        StopReason reason;
+        const ThreadedOp* op = &code[current_state];
+
+#if MMT_COMPUTED_GOTO
+        static const void* const labels[] = {
+            &&op_accept, &&op_halt, &&op_dispatch, &&op_dispatch_sparse, &&op_transition, &&op_sweep, &&op_call
+        };
+#define MMT_DISPATCH() goto *labels[op->opcode]
+#else
+#define MMT_DISPATCH() goto dispatch
+    dispatch:
+        switch (op->opcode) {
+        case OP_ACCEPT: goto op_accept;
+        case OP_HALT: goto op_halt;
+        case OP_DISPATCH: goto op_dispatch;
+        case OP_DISPATCH_SPARSE: goto op_dispatch_sparse;
+        case OP_TRANSITION: goto op_transition;
+        case OP_SWEEP: goto op_sweep;
+        default: goto op_call;
+        }
+#endif
+
+        MMT_DISPATCH();
+
+    op_accept:
+        current_state = op->index;
+        if (!call_stack.empty()) {
+            // Допускающее состояние вызванной машины - шаг возврата
+            if (done == budget) goto out_of_budget;
+            PopCall();
+            ++done;
+            p = &Running();
+            code = p->threaded_code.data();
+            state_count = p->state_names.size();
+            op = &code[current_state];
+            MMT_DISPATCH();
+        }
+        reason = done >= limit ? StopReason::StepLimit : StopReason::Accepted;
+        goto finish;
+
+    op_halt:
+        current_state = op->index;
+        if (done == budget) goto out_of_budget;
+        reason = StopReason::Halted;
+        goto finish;
+
+    op_dispatch:
+    op_dispatch_sparse:
+        if (done == budget) {
+            current_state = op->index;
+            goto out_of_budget;
+        }
+        {
+            int32_t t = LookupTransition(*p, op->index);
+            if (t < 0) {
+                current_state = op->index;
+                reason = StopReason::Halted;
+                goto finish;
+            }
+            op = &code[state_count + t];
+        }
+        MMT_DISPATCH();
+
+    op_transition:
+        {
+            const CompiledTransition& t = p->transitions[op->index];
+            WriteAndMove(t);
+            ++done;
+            op = &code[t.state_to];
+        }
+        MMT_DISPATCH();
+
+    op_sweep:
+        {
+            const CompiledTransition& t = p->transitions[op->index];
+            done += SweepTapes(p->sweeps[t.sweep], budget - done);
+            op = &code[t.state_to];
+        }
+        MMT_DISPATCH();
+
+    op_call:
+        {
+            PushCall(*p, p->transitions[op->index]);
+            ++done;
+            p = &Running();
+            code = p->threaded_code.data();
+            state_count = p->state_names.size();
+            op = &code[current_state];
+        }
+        MMT_DISPATCH();
+
+#undef MMT_DISPATCH
+
+    out_of_budget:
+        reason = done >= limit ? StopReason::StepLimit : StopReason::MaxStepsExceeded;
+
+    finish:
+        step_count += done;
+        return reason;
+    }
+};
+
+// Создать машину с числом лент, известным только во время выполнения
+inline std::unique_ptr<TuringMachine> CreateTuringMachine(const std::string& start,
+    size_t num_tapes = 1,
+    char blank = ' ',
+    size_t max_steps_limit = 1000000,
+    ExecutionEngine execution_engine = ExecutionEngine::Interpreter) {
+    switch (num_tapes) {
+    case 1: return std::make_unique<MultiTapeTuringMachine<1>>(start, blank, max_steps_limit, execution_engine);
+    case 2: return std::make_unique<MultiTapeTuringMachine<2>>(start, blank, max_steps_limit, execution_engine);
+    case 3: return std::make_unique<MultiTapeTuringMachine<3>>(start, blank, max_steps_limit, execution_engine);
+    case 4: return std::make_unique<MultiTapeTuringMachine<4>>(start, blank, max_steps_limit, execution_engine);
+    case 5: return std::make_unique<MultiTapeTuringMachine<5>>(start, blank, max_steps_limit, execution_engine);
+    case 6: return std::make_unique<MultiTapeTuringMachine<6>>(start, blank, max_steps_limit, execution_engine);
+    case 7: return std::make_unique<MultiTapeTuringMachine<7>>(start, blank, max_steps_limit, execution_engine);
+    case 8: return std::make_unique<MultiTapeTuringMachine<8>>(start, blank, max_steps_limit, execution_engine);
+    default:
+        throw std::invalid_argument("Number of tapes must be between 1 and " + std::to_string(TuringMachine::MAX_TAPES));
+    }
+}
@@ -33,36 +33,8 @@ public:
         std::string code = "# Copy Alphanumeric (A-Z, a-z, 0-9)\n";
         code += "# Tape 1: input, Tape 2: output\n\n";
 
-        for (char c = 'A'; c <= 'Z'; ++c) {
-            code += "q0,";
-            code += c;
-            code += ", , ->q0,";
-            code += c;
-            code += ",";
-            code += c;
-            code += ", ,R,R,S\n";
-        }
-
-        for (char c = 'a'; c <= 'z'; ++c) {
-            code += "q0,";
-            code += c;
-            code += ", , ->q0,";
-            code += c;
-            code += ",";
-            code += c;
-            code += ", ,R,R,S\n";
-        }
-
-        for (char c = '0'; c <= '9'; ++c) {
-            code += "q0,";
-            code += c;
-            code += ", , ->q0,";
-            code += c;
-            code += ",";
-            code += c;
-            code += ", ,R,R,S\n";
-        }
-
+        //     : "="     1, "=1"     2
+        code += "q0,[A-Za-z0-9], , ->q0,=,=1, ,R,R,S\n";
         code += "q0, , , ->q1, , , ,S,S,S\n";
         return code;
     }